@@ -0,0 +1,690 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "json.h"
+#include "csv.h"
+#include "expression.h"
+#include "commands.h"
+#include "test.h"
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// counted by the replaced global operator new; the benchmark is single-threaded
+static std::size_t allocationCount = 0;
+static std::size_t allocatedBytes = 0;
+
+void *operator new(std::size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+    if(void *retval = std::malloc(size ? size : 1))
+        return retval;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+namespace
+{
+typedef std::mt19937_64 RandomEngine;
+
+std::size_t randomIndex(RandomEngine &re, std::size_t count)
+{
+    return std::uniform_int_distribution<std::size_t>(0, count - 1)(re);
+}
+
+std::string makeWord(RandomEngine &re)
+{
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+    std::string retval;
+    std::size_t size = 1 + randomIndex(re, 10);
+    for(std::size_t i = 0; i < size; i++)
+        retval += letters[randomIndex(re, sizeof(letters) - 1)];
+    return retval;
+}
+
+std::string makeNumber(RandomEngine &re)
+{
+    return std::to_string(randomIndex(re, 100000));
+}
+
+void writeJSONValue(RandomEngine &re, std::string &out, std::size_t depth)
+{
+    switch(randomIndex(re, depth < 4 ? 8 : 5))
+    {
+    case 0:
+        out += "\"" + makeWord(re) + (randomIndex(re, 4) == 0 ? "\\n\\u00e9\"" : "\"");
+        break;
+    case 1:
+        out += makeNumber(re);
+        break;
+    case 2:
+        out += "-" + makeNumber(re) + "." + makeNumber(re) + "e+" + std::to_string(randomIndex(re, 30));
+        break;
+    case 3:
+        out += randomIndex(re, 2) ? "true" : "false";
+        break;
+    case 4:
+        out += "null";
+        break;
+    case 5:
+    case 6:
+    {
+        out += "{";
+        std::size_t count = randomIndex(re, 5);
+        for(std::size_t i = 0; i < count; i++)
+        {
+            out += i == 0 ? "\"" : ", \"";
+            out += makeWord(re) + "\": ";
+            writeJSONValue(re, out, depth + 1);
+        }
+        out += "}";
+        break;
+    }
+    default:
+    {
+        out += "[";
+        std::size_t count = randomIndex(re, 5);
+        for(std::size_t i = 0; i < count; i++)
+        {
+            if(i != 0)
+                out += ", ";
+            writeJSONValue(re, out, depth + 1);
+        }
+        out += "]";
+        break;
+    }
+    }
+}
+
+std::string makeJSONCorpus(RandomEngine &re, std::size_t size)
+{
+    std::string retval = "[\n";
+    while(retval.size() < size)
+    {
+        if(retval.size() > 2)
+            retval += ",\n";
+        retval += "    {\"id\": " + makeNumber(re) + ", \"value\": ";
+        writeJSONValue(re, retval, 0);
+        retval += "}";
+    }
+    retval += "\n]\n";
+    return retval;
+}
+
+std::string makeCSVCorpus(RandomEngine &re, std::size_t size)
+{
+    std::string retval;
+    while(retval.size() < size)
+    {
+        for(std::size_t i = 0; i < 8; i++)
+        {
+            if(i != 0)
+                retval += ",";
+            switch(randomIndex(re, 4))
+            {
+            case 0:
+                retval += makeNumber(re);
+                break;
+            case 1:
+                retval += makeWord(re) + " " + makeWord(re);
+                break;
+            case 2:
+                retval += "\"" + makeWord(re) + ", \"\"" + makeWord(re) + "\"\"\r\n\"";
+                break;
+            default:
+                break;
+            }
+        }
+        retval += randomIndex(re, 2) ? "\r\n" : "\n";
+    }
+    return retval;
+}
+
+void writeExpression(RandomEngine &re, std::string &out, std::size_t depth)
+{
+    static const char *const operators[] = {" + ", " - ", " * ", " / ", " % "};
+    std::size_t count = 1 + randomIndex(re, 4);
+    for(std::size_t i = 0; i < count; i++)
+    {
+        if(i != 0)
+            out += operators[randomIndex(re, 5)];
+        if(depth < 4 && randomIndex(re, 4) == 0)
+        {
+            out += "(";
+            writeExpression(re, out, depth + 1);
+            out += ")";
+        }
+        else
+        {
+            if(randomIndex(re, 8) == 0)
+                out += "-";
+            out += makeNumber(re);
+        }
+    }
+}
+
+std::string makeExpressionCorpus(RandomEngine &re, std::size_t size)
+{
+    std::string retval;
+    while(retval.size() < size)
+    {
+        writeExpression(re, retval, 0);
+        retval += ";\n";
+    }
+    return retval;
+}
+
+void writeCommandExpression(RandomEngine &re, std::string &out, std::size_t depth)
+{
+    static const char *const operators[] = {" + ", " - ", " * "};
+    std::size_t count = 1 + randomIndex(re, 3);
+    for(std::size_t i = 0; i < count; i++)
+    {
+        if(i != 0)
+            out += operators[randomIndex(re, 3)];
+        switch(randomIndex(re, depth < 2 ? 4 : 3))
+        {
+        case 0:
+            out += makeWord(re);
+            break;
+        case 1:
+            out += makeNumber(re);
+            break;
+        case 2:
+            out += "\"" + makeWord(re) + " " + makeWord(re) + "\"";
+            break;
+        default:
+            out += "(";
+            writeCommandExpression(re, out, depth + 1);
+            out += ")";
+            break;
+        }
+    }
+}
+
+void writeCommandArguments(RandomEngine &re, std::string &out)
+{
+    std::size_t count = 1 + randomIndex(re, 3);
+    for(std::size_t i = 0; i < count; i++)
+    {
+        if(i != 0)
+            out += ", ";
+        writeCommandExpression(re, out, 0);
+    }
+}
+
+std::string makeCommandsCorpus(RandomEngine &re, std::size_t size)
+{
+    std::string retval;
+    while(retval.size() < size)
+    {
+        switch(randomIndex(re, 4))
+        {
+        case 0:
+            retval += "set " + makeWord(re) + " = ";
+            writeCommandExpression(re, retval, 0);
+            break;
+        case 1:
+            retval += "print ";
+            writeCommandArguments(re, retval);
+            break;
+        case 2:
+            retval += "delete " + makeWord(re);
+            break;
+        default:
+            retval += makeWord(re) + "(";
+            if(randomIndex(re, 4) != 0)
+                writeCommandArguments(re, retval);
+            retval += ")";
+            break;
+        }
+        retval += "\n";
+    }
+    return retval;
+}
+
+// a trailing underscore keeps identifiers from being keywords
+std::string makeTestIdentifier(RandomEngine &re)
+{
+    return makeWord(re) + "_";
+}
+
+// matches the ecmascript-like expressions of test.peg
+void writeTestExpression(RandomEngine &re, std::string &out, std::size_t depth)
+{
+    static const char *const operators[] = {" + ", " - ", " * ", " / ", " % ", ", "};
+    std::size_t count = 1 + randomIndex(re, 4);
+    for(std::size_t i = 0; i < count; i++)
+    {
+        if(i != 0)
+            out += operators[randomIndex(re, 6)];
+        switch(randomIndex(re, depth < 3 ? 6 : 4))
+        {
+        case 0:
+            out += makeTestIdentifier(re) + "." + makeTestIdentifier(re) + "."
+                   + makeTestIdentifier(re);
+            break;
+        case 1:
+            out += makeNumber(re) + "." + makeNumber(re) + "e3";
+            break;
+        case 2:
+            out += "new " + makeTestIdentifier(re) + "." + makeTestIdentifier(re);
+            break;
+        case 3:
+            out += makeTestIdentifier(re) + " /* " + makeWord(re) + " */";
+            break;
+        default:
+            out += "(";
+            writeTestExpression(re, out, depth + 1);
+            out += ")";
+            break;
+        }
+    }
+}
+
+std::string makeTestCorpus(RandomEngine &re, std::size_t size)
+{
+    std::string retval;
+    while(retval.size() < size)
+    {
+        writeTestExpression(re, retval, 0);
+        retval += randomIndex(re, 4) == 0 ? "; // " + makeWord(re) + "\n" : ";\n";
+    }
+    return retval;
+}
+
+struct Result final
+{
+    enum class Status
+    {
+        Success,
+        ParseError,
+        OutOfMemory,
+        Crashed,
+    };
+    Status status = Status::Crashed;
+    std::size_t corpusSize = 0;
+    double seconds = 0;
+    std::size_t iterations = 0;
+    std::size_t allocationCount = 0;
+    std::size_t allocatedBytes = 0;
+    std::size_t memoTableSize = 0;
+    std::size_t peakResidentSetSize = 0;
+};
+
+template <typename ParseFunction>
+Result measure(const std::string &corpus, ParseFunction parseFunction)
+{
+    // small corpora are parsed repeatedly so the time is measurable
+    constexpr double minimumSeconds = 0.2;
+    Result retval;
+    retval.corpusSize = corpus.size();
+    auto startTime = std::chrono::steady_clock::now();
+    do
+    {
+        std::size_t startAllocationCount = allocationCount;
+        std::size_t startAllocatedBytes = allocatedBytes;
+        retval.status = parseFunction(corpus, retval.memoTableSize) ? Result::Status::Success :
+                                                                      Result::Status::ParseError;
+        retval.allocationCount = allocationCount - startAllocationCount;
+        retval.allocatedBytes = allocatedBytes - startAllocatedBytes;
+        retval.iterations++;
+        retval.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime)
+                             .count();
+    } while(retval.status == Result::Status::Success && retval.seconds < minimumSeconds);
+    return retval;
+}
+
+template <typename Parser>
+bool parseWithMemoTableSize(Parser &parser, bool success, std::size_t &memoTableSize)
+{
+    memoTableSize = parser.getMemoTableSize();
+    return success;
+}
+
+struct Benchmark final
+{
+    const char *name;
+    std::string (*makeCorpus)(RandomEngine &re, std::size_t size);
+    bool (*parse)(const std::string &corpus, std::size_t &memoTableSize);
+};
+
+const Benchmark benchmarks[] = {
+    {"json",
+     makeJSONCorpus,
+     [](const std::string &corpus, std::size_t &memoTableSize) -> bool
+     {
+         benchmark::json::Parser parser(
+             benchmark::json::Parser::BorrowedSource(), corpus.data(), corpus.size());
+         return parseWithMemoTableSize(
+             parser, static_cast<bool>(parser.tryParseGoal()), memoTableSize);
+     }},
+    {"csv",
+     makeCSVCorpus,
+     [](const std::string &corpus, std::size_t &memoTableSize) -> bool
+     {
+         benchmark::csv::Parser parser(
+             benchmark::csv::Parser::BorrowedSource(), corpus.data(), corpus.size());
+         return parseWithMemoTableSize(
+             parser, static_cast<bool>(parser.tryParseGoal()), memoTableSize);
+     }},
+    {"expression",
+     makeExpressionCorpus,
+     [](const std::string &corpus, std::size_t &memoTableSize) -> bool
+     {
+         benchmark::expression::Parser parser(
+             benchmark::expression::Parser::BorrowedSource(), corpus.data(), corpus.size());
+         return parseWithMemoTableSize(
+             parser, static_cast<bool>(parser.tryParseGoal()), memoTableSize);
+     }},
+    {"commands",
+     makeCommandsCorpus,
+     [](const std::string &corpus, std::size_t &memoTableSize) -> bool
+     {
+         benchmark::commands::Parser parser(
+             benchmark::commands::Parser::BorrowedSource(), corpus.data(), corpus.size());
+         return parseWithMemoTableSize(
+             parser, static_cast<bool>(parser.tryParseGoal()), memoTableSize);
+     }},
+    {"test.peg",
+     makeTestCorpus,
+     [](const std::string &corpus, std::size_t &memoTableSize) -> bool
+     {
+         // test.peg writes each statement to std::cout
+         std::streambuf *savedBuffer = std::cout.rdbuf(nullptr);
+         parser::Parser parser(
+             parser::Parser::BorrowedSource(), corpus.data(), corpus.size());
+         bool success = static_cast<bool>(parser.tryParseGoal<true, true>());
+         std::cout.rdbuf(savedBuffer);
+         std::cout.clear();
+         return parseWithMemoTableSize(parser, success, memoTableSize);
+     }},
+};
+
+std::size_t getPeakResidentSetSize()
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// half of the physical memory, or 0 if unknown
+std::size_t getDefaultMemoryLimit()
+{
+    long pageCount = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if(pageCount <= 0 || pageSize <= 0)
+        return 0;
+    return static_cast<std::size_t>(pageCount) / 2 * static_cast<std::size_t>(pageSize);
+}
+
+// runs in a child process so the peak resident set size is per benchmark; the child's address
+// space is limited to memoryLimit bytes (unless it's 0) so running out of memory throws
+// std::bad_alloc instead of swapping
+Result run(const Benchmark &benchmark, std::size_t size, std::size_t memoryLimit)
+{
+    Result retval;
+    int pipeFds[2];
+    if(pipe(pipeFds) != 0)
+        return retval;
+    std::cout.flush();
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        return retval;
+    }
+    if(pid == 0)
+    {
+        close(pipeFds[0]);
+        if(memoryLimit != 0)
+        {
+            struct rlimit limit;
+            limit.rlim_cur = static_cast<rlim_t>(memoryLimit);
+            limit.rlim_max = static_cast<rlim_t>(memoryLimit);
+            setrlimit(RLIMIT_AS, &limit);
+        }
+        Result childResult;
+        try
+        {
+            RandomEngine re(size);
+            std::string corpus = benchmark.makeCorpus(re, size);
+            childResult = measure(corpus, benchmark.parse);
+        }
+        catch(std::bad_alloc &)
+        {
+            childResult.status = Result::Status::OutOfMemory;
+        }
+        childResult.peakResidentSetSize = getPeakResidentSetSize();
+        ssize_t written = write(pipeFds[1], &childResult, sizeof(childResult));
+        _exit(written == static_cast<ssize_t>(sizeof(childResult)) ? 0 : 1);
+    }
+    close(pipeFds[1]);
+    ssize_t readSize = read(pipeFds[0], &retval, sizeof(retval));
+    close(pipeFds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if(readSize != static_cast<ssize_t>(sizeof(retval)) || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+        retval.status = Result::Status::Crashed;
+    return retval;
+}
+
+bool parseSize(std::string text, std::size_t &size)
+{
+    std::size_t multiplier = 1;
+    if(!text.empty())
+    {
+        switch(text.back())
+        {
+        case 'K':
+            multiplier = 1024;
+            break;
+        case 'M':
+            multiplier = 1024 * 1024;
+            break;
+        case 'G':
+            multiplier = 1024 * 1024 * 1024;
+            break;
+        }
+        if(multiplier != 1)
+            text.pop_back();
+    }
+    std::istringstream ss(text);
+    if(text.empty() || !std::isdigit(static_cast<unsigned char>(text[0])) || !(ss >> size)
+       || !ss.eof() || size == 0)
+        return false;
+    size *= multiplier;
+    return true;
+}
+
+std::string formatSize(std::size_t size)
+{
+    static const char *const units[] = {"B", "KB", "MB", "GB"};
+    std::size_t unit = 0;
+    while(unit < 3 && size >= 1024 && size % 1024 == 0)
+    {
+        size /= 1024;
+        unit++;
+    }
+    return std::to_string(size) + units[unit];
+}
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t minimumSize = 1024;
+    std::size_t maximumSize = 1024 * 1024 * 1024;
+    std::size_t memoryLimit = getDefaultMemoryLimit();
+    std::string grammarName;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "-h" || arg == "--help")
+        {
+            std::cout << R"(usage: peg_benchmark [<options>]
+Parses deterministic generated corpora with parsers generated from reference
+grammars, reporting throughput, peak resident set size, allocations and
+memo table size. Corpus sizes grow by 4x from the minimum to the maximum.
+Options:
+-h
+--help             Show this help.
+--min-size=<size>  Set the smallest corpus size. Default: 1K.
+--max-size=<size>  Set the largest corpus size. Default: 1G.
+--grammar=<name>   Only run the benchmark for one grammar: json, csv,
+                   expression, commands or test.peg.
+--memory-limit=<size>
+                   Limit the address space of each run; runs that need more
+                   are reported as out of memory. 0 means no limit.
+                   Default: half of the physical memory.
+Sizes are in bytes and can end in K, M or G.
+)";
+            return 0;
+        }
+        if(arg.compare(0, 11, "--min-size=") == 0)
+        {
+            if(!parseSize(arg.substr(11), minimumSize))
+            {
+                std::cerr << "invalid --min-size argument" << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if(arg.compare(0, 11, "--max-size=") == 0)
+        {
+            if(!parseSize(arg.substr(11), maximumSize))
+            {
+                std::cerr << "invalid --max-size argument" << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if(arg.compare(0, 15, "--memory-limit=") == 0)
+        {
+            if(arg.substr(15) == "0")
+                memoryLimit = 0;
+            else if(!parseSize(arg.substr(15), memoryLimit))
+            {
+                std::cerr << "invalid --memory-limit argument" << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if(arg.compare(0, 10, "--grammar=") == 0)
+        {
+            grammarName = arg.substr(10);
+            continue;
+        }
+        std::cerr << "invalid option" << std::endl;
+        return 1;
+    }
+    bool foundGrammar = grammarName.empty();
+    bool allSucceeded = true;
+    std::cout << std::left << std::setw(12) << "grammar" << std::right << std::setw(8) << "size"
+              << std::setw(10) << "MB/s" << std::setw(12) << "peak RSS" << std::setw(14)
+              << "allocations" << std::setw(14) << "allocated" << std::setw(12) << "memo table"
+              << std::endl;
+    for(const Benchmark &benchmark : benchmarks)
+    {
+        if(!grammarName.empty() && grammarName != benchmark.name)
+            continue;
+        foundGrammar = true;
+        for(std::size_t size = minimumSize; size <= maximumSize; size *= 4)
+        {
+            std::cout << std::left << std::setw(12) << benchmark.name << std::right
+                      << std::setw(8) << formatSize(size);
+            Result result = run(benchmark, size, memoryLimit);
+            if(result.status == Result::Status::OutOfMemory)
+            {
+                // larger corpora won't fit either
+                std::cout << "  out of memory" << std::endl;
+                break;
+            }
+            if(result.status != Result::Status::Success)
+            {
+                std::cout << (result.status == Result::Status::ParseError ? "  parse error" :
+                                                                            "  crashed")
+                          << std::endl;
+                allSucceeded = false;
+                break;
+            }
+            double megabytesPerSecond =
+                static_cast<double>(result.corpusSize) * result.iterations / result.seconds / 1e6;
+            std::cout << std::fixed << std::setprecision(1) << std::setw(10)
+                      << megabytesPerSecond << std::setw(10)
+                      << result.peakResidentSetSize / 1e6 << "MB" << std::setw(14)
+                      << result.allocationCount << std::setw(12)
+                      << result.allocatedBytes / 1e6 << "MB" << std::setw(10)
+                      << result.memoTableSize / 1e6 << "MB" << std::endl;
+            if(size > maximumSize / 4)
+                break;
+        }
+    }
+    if(!foundGrammar)
+    {
+        std::cerr << "unknown grammar: " << grammarName << std::endl;
+        return 1;
+    }
+    return allSucceeded ? 0 : 1;
+}
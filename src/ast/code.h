@@ -38,6 +38,7 @@ struct ExpressionCodeSnippet final : public Expression
             ReturnValue,
             PredicateReturnValue,
             Location,
+            Move, // $move(name): the parenthesized name follows position in code
         };
         Kind kind;
         std::size_t position;
@@ -73,6 +74,10 @@ struct ExpressionCodeSnippet final : public Expression
     {
         return true;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return FirstSet();
+    }
 };
 struct TopLevelCodeSnippet final : public Node
 {
@@ -20,6 +20,7 @@
  */
 #include "dump_visitor.h"
 #include "empty.h"
+#include "cut.h"
 #include "grammar.h"
 #include "nonterminal.h"
 #include "ordered_choice.h"
@@ -97,6 +98,13 @@ void DumpVisitor::visitEmpty(Empty *node)
     os << "Empty" << std::endl;
 }
 
+void DumpVisitor::visitCut(Cut *node)
+{
+    assert(node);
+    indent();
+    os << "Cut" << std::endl;
+}
+
 void DumpVisitor::visitGrammar(Grammar *node)
 {
     indent();
@@ -124,7 +132,9 @@ void DumpVisitor::visitNonterminal(Nonterminal *node)
 {
     indent();
     os << "Nonterminal name = \"" << node->name
-       << "\" caching = " << (node->settings.caching ? "true" : "false") << std::endl;
+       << "\" caching = " << (node->settings.caching ? "true" : "false")
+       << " memoizeValue = " << (node->settings.memoizeValue ? "true" : "false")
+       << " forceInline = " << (node->settings.forceInline ? "true" : "false") << std::endl;
     indentDepth++;
     for(auto templateArgument : node->templateArguments)
     {
@@ -229,6 +239,17 @@ void DumpVisitor::visitTerminal(Terminal *node)
        << static_cast<unsigned long>(node->value) << ")" << std::endl;
 }
 
+void DumpVisitor::visitLiteral(Literal *node)
+{
+    indent();
+    os << "Literal value = \"";
+    for(auto ch : node->value)
+    {
+        os << escapeCharacter(ch);
+    }
+    os << "\"" << std::endl;
+}
+
 void DumpVisitor::visitCharacterClass(CharacterClass *node)
 {
     indent();
@@ -48,6 +48,7 @@ public:
     }
     static std::string escapeCharacter(char32_t ch);
     virtual void visitEmpty(Empty *node) override;
+    virtual void visitCut(Cut *node) override;
     virtual void visitGrammar(Grammar *node) override;
     virtual void visitNonterminal(Nonterminal *node) override;
     virtual void visitNonterminalExpression(NonterminalExpression *node) override;
@@ -60,6 +61,7 @@ public:
     virtual void visitOptionalExpression(OptionalExpression *node) override;
     virtual void visitSequence(Sequence *node) override;
     virtual void visitTerminal(Terminal *node) override;
+    virtual void visitLiteral(Literal *node) override;
     virtual void visitCharacterClass(CharacterClass *node) override;
     virtual void visitEOFTerminal(EOFTerminal *node) override;
     virtual void visitExpressionCodeSnippet(ExpressionCodeSnippet *node) override;
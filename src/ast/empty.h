@@ -46,6 +46,10 @@ struct Empty final : public Expression
     {
         return true;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return FirstSet();
+    }
 };
 }
 
@@ -23,6 +23,7 @@
 #define AST_EXPRESSION_H_
 
 #include "node.h"
+#include "first_set.h"
 
 namespace ast
 {
@@ -32,6 +33,8 @@ struct Expression : public Node
     virtual bool defaultNeedsCaching() = 0;
     virtual bool hasLeftRecursion() = 0;
     virtual bool canAcceptEmptyString() = 0;
+    // the characters that can start a non-empty match
+    virtual FirstSet getFirstSet() = 0;
 };
 }
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef AST_FIRST_SET_H_
+#define AST_FIRST_SET_H_
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+namespace ast
+{
+struct FirstSet final
+{
+    struct Range final
+    {
+        char32_t min, max;
+        constexpr Range(char32_t min, char32_t max) : min(min), max(max)
+        {
+        }
+        constexpr bool operator==(const Range &rt) const
+        {
+            return min == rt.min && max == rt.max;
+        }
+    };
+    static constexpr char32_t maxCharacter()
+    {
+        return 0xFFFFFFFFUL;
+    }
+    std::vector<Range> ranges; // sorted, disjoint and non-adjacent
+    bool empty() const noexcept
+    {
+        return ranges.empty();
+    }
+    bool contains(char32_t value) const noexcept
+    {
+        auto iter = std::upper_bound(ranges.begin(),
+                                     ranges.end(),
+                                     value,
+                                     [](char32_t a, const Range &b)
+                                     {
+                                         return a < b.min;
+                                     });
+        if(iter == ranges.begin())
+            return false;
+        --iter;
+        return value <= iter->max;
+    }
+    bool overlaps(char32_t min, char32_t max) const noexcept
+    {
+        for(const Range &range : ranges)
+        {
+            if(range.min <= max && range.max >= min)
+                return true;
+        }
+        return false;
+    }
+    void insert(char32_t min, char32_t max)
+    {
+        if(max < min)
+            return;
+        std::size_t index = 0;
+        while(index < ranges.size()
+              && ranges[index].max + static_cast<std::uint_fast64_t>(1) < min)
+            index++;
+        std::size_t endIndex = index;
+        while(endIndex < ranges.size()
+              && ranges[endIndex].min <= max + static_cast<std::uint_fast64_t>(1))
+        {
+            min = std::min(min, ranges[endIndex].min);
+            max = std::max(max, ranges[endIndex].max);
+            endIndex++;
+        }
+        ranges.erase(ranges.begin() + index, ranges.begin() + endIndex);
+        ranges.insert(ranges.begin() + index, Range(min, max));
+    }
+    // returns true if this set changed
+    bool insert(const FirstSet &other)
+    {
+        std::vector<Range> oldRanges = ranges;
+        for(const Range &range : other.ranges)
+            insert(range.min, range.max);
+        return ranges != oldRanges;
+    }
+    FirstSet complement() const
+    {
+        FirstSet retval;
+        std::uint_fast64_t nextMin = 0;
+        for(const Range &range : ranges)
+        {
+            if(range.min > nextMin)
+                retval.ranges.emplace_back(static_cast<char32_t>(nextMin), range.min - 1);
+            nextMin = range.max + static_cast<std::uint_fast64_t>(1);
+        }
+        if(nextMin <= maxCharacter())
+            retval.ranges.emplace_back(static_cast<char32_t>(nextMin), maxCharacter());
+        return retval;
+    }
+};
+}
+
+#endif /* AST_FIRST_SET_H_ */
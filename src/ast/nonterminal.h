@@ -131,8 +131,14 @@ struct Nonterminal final : public Node
     struct Settings final
     {
         bool caching = true;
+        bool memoizeValue = false;
+        // set by @memo, @nomemo or @inline; caching isn't changed by the heuristics
+        bool cachingOverridden = false;
+        bool forceInline = false;
         bool hasLeftRecursion = true;
         bool canAcceptEmptyString = true;
+        bool hasCut = false;
+        FirstSet firstSet;
     };
     Settings settings;
     std::vector<TemplateVariableDeclaration *> templateArguments;
@@ -214,6 +220,10 @@ struct NonterminalExpression final : public Expression
     {
         return value->settings.canAcceptEmptyString;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return value->settings.firstSet;
+    }
 };
 }
 
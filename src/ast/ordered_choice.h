@@ -52,6 +52,12 @@ struct OrderedChoice final : public Expression
     {
         return first->canAcceptEmptyString() || second->canAcceptEmptyString();
     }
+    virtual FirstSet getFirstSet() override
+    {
+        FirstSet retval = first->getFirstSet();
+        retval.insert(second->getFirstSet());
+        return retval;
+    }
 };
 }
 
@@ -51,6 +51,10 @@ struct FollowedByPredicate final : public Expression
     {
         return true;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return FirstSet();
+    }
 };
 
 struct NotFollowedByPredicate final : public Expression
@@ -76,6 +80,10 @@ struct NotFollowedByPredicate final : public Expression
     {
         return true;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return FirstSet();
+    }
 };
 
 struct ExpressionCodeSnippet;
@@ -103,6 +111,10 @@ struct CustomPredicate final : public Expression
     {
         return true;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return FirstSet();
+    }
 };
 }
 
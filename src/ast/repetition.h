@@ -51,6 +51,10 @@ struct GreedyRepetition final : public Expression
     {
         return true;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return expression->getFirstSet();
+    }
 };
 
 struct GreedyPositiveRepetition final : public Expression
@@ -76,6 +80,10 @@ struct GreedyPositiveRepetition final : public Expression
     {
         return expression->canAcceptEmptyString();
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return expression->getFirstSet();
+    }
 };
 
 struct OptionalExpression final : public Expression
@@ -101,6 +109,10 @@ struct OptionalExpression final : public Expression
     {
         return true;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return expression->getFirstSet();
+    }
 };
 }
 
@@ -53,6 +53,13 @@ struct Sequence final : public Expression
     {
         return first->canAcceptEmptyString() && second->canAcceptEmptyString();
     }
+    virtual FirstSet getFirstSet() override
+    {
+        FirstSet retval = first->getFirstSet();
+        if(first->canAcceptEmptyString())
+            retval.insert(second->getFirstSet());
+        return retval;
+    }
 };
 }
 
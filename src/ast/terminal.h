@@ -26,6 +26,7 @@
 #include "visitor.h"
 #include <utility>
 #include <vector>
+#include <string>
 #include <algorithm>
 #include <cstdint>
 
@@ -53,6 +54,44 @@ struct Terminal final : public Expression
     {
         return false;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        FirstSet retval;
+        retval.insert(value, value);
+        return retval;
+    }
+};
+
+struct Literal final : public Expression
+{
+    std::u32string value;
+    Literal(Location location, std::u32string value)
+        : Expression(std::move(location)), value(std::move(value))
+    {
+    }
+    virtual void visit(Visitor &visitor) override
+    {
+        visitor.visitLiteral(this);
+    }
+    virtual bool defaultNeedsCaching() override
+    {
+        return false;
+    }
+    virtual bool hasLeftRecursion() override
+    {
+        return false;
+    }
+    virtual bool canAcceptEmptyString() override
+    {
+        return value.empty();
+    }
+    virtual FirstSet getFirstSet() override
+    {
+        FirstSet retval;
+        if(!value.empty())
+            retval.insert(value[0], value[0]);
+        return retval;
+    }
 };
 
 struct CharacterClass final : public Expression
@@ -384,6 +423,15 @@ struct CharacterClass final : public Expression
     {
         return false;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        FirstSet retval;
+        for(const auto &range : characterRanges.ranges)
+            retval.insert(range.min, range.max);
+        if(inverted)
+            return retval.complement();
+        return retval;
+    }
 };
 
 struct EOFTerminal final : public Expression
@@ -405,6 +453,10 @@ struct EOFTerminal final : public Expression
     {
         return true;
     }
+    virtual FirstSet getFirstSet() override
+    {
+        return FirstSet();
+    }
 };
 }
 
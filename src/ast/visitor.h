@@ -25,6 +25,7 @@
 namespace ast
 {
 struct Empty;
+struct Cut;
 struct Grammar;
 struct Nonterminal;
 struct NonterminalExpression;
@@ -37,6 +38,7 @@ struct GreedyPositiveRepetition;
 struct OptionalExpression;
 struct Sequence;
 struct Terminal;
+struct Literal;
 struct CharacterClass;
 struct EOFTerminal;
 struct ExpressionCodeSnippet;
@@ -51,6 +53,7 @@ struct Visitor
 {
     virtual ~Visitor() = default;
     virtual void visitEmpty(Empty *node) = 0;
+    virtual void visitCut(Cut *node) = 0;
     virtual void visitGrammar(Grammar *node) = 0;
     virtual void visitNonterminal(Nonterminal *node) = 0;
     virtual void visitNonterminalExpression(NonterminalExpression *node) = 0;
@@ -63,6 +66,7 @@ struct Visitor
     virtual void visitOptionalExpression(OptionalExpression *node) = 0;
     virtual void visitSequence(Sequence *node) = 0;
     virtual void visitTerminal(Terminal *node) = 0;
+    virtual void visitLiteral(Literal *node) = 0;
     virtual void visitCharacterClass(CharacterClass *node) = 0;
     virtual void visitEOFTerminal(EOFTerminal *node) = 0;
     virtual void visitExpressionCodeSnippet(ExpressionCodeSnippet *node) = 0;
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "bytecode.h"
+#include "arena.h"
+#include "code_generator.h"
+#include "error.h"
+#include "parser.h"
+#include "source.h"
+#include "ast/grammar.h"
+#include <cstring>
+
+namespace bytecode
+{
+constexpr std::size_t ProgramView::noRule;
+
+std::size_t ProgramView::findRule(const std::string &name) const
+{
+    for(std::size_t i = 0; i < ruleCount; i++)
+    {
+        if(std::strcmp(getString(rules[i].name), name.c_str()) == 0)
+            return i;
+    }
+    return noRule;
+}
+
+ProgramView Program::getView() const
+{
+    ProgramView retval;
+    retval.code = code.data();
+    retval.codeSize = code.size();
+    retval.rules = rules.data();
+    retval.ruleCount = rules.size();
+    retval.characters = characters.data();
+    retval.characterCount = characters.size();
+    retval.bitmaps = bitmaps.data();
+    retval.bitmapsSize = bitmaps.size();
+    retval.firstSets = firstSets.data();
+    retval.firstSetsSize = firstSets.size();
+    retval.strings = strings.data();
+    retval.stringsSize = strings.size();
+    retval.memoSlotCount = memoSlotCount;
+    return retval;
+}
+
+bool compileGrammar(ErrorHandler &errorHandler, const std::string &fileName, Program &program)
+{
+    Arena arena;
+    try
+    {
+        const Source *source = Source::load(arena, errorHandler, fileName);
+        ast::Grammar *grammar = parseGrammar(arena, errorHandler, source);
+        if(errorHandler.hasAnyErrors())
+            return false;
+        CodeGenerator::makeBytecode(errorHandler, program)->generateCode(grammar);
+    }
+    catch(FatalError &)
+    {
+    }
+    return !errorHandler.hasAnyErrors();
+}
+}
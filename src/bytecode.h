@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef BYTECODE_H_
+#define BYTECODE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct ErrorHandler;
+
+// a grammar compiled by CodeGenerator::makeBytecode, run by bytecode::BasicInterpreter
+namespace bytecode
+{
+typedef std::uint32_t Word;
+
+enum class Opcode : Word
+{
+    Empty,
+    Cut,
+    Call, // rule index
+    Choice, // first sets, then alternatives follow
+    Sequence, // elements follow
+    Repetition, // expression follows
+    PositiveRepetition, // expression follows
+    Optional, // expression follows
+    FollowedBy, // expression follows
+    NotFollowedBy, // expression follows
+    CustomPredicate,
+    Terminal, // character, message
+    Literal, // first character, character count, a message per character
+    CharacterClass, // flags, first range, range count, bitmap, message
+    EndOfFile,
+};
+
+// the first word of an instruction holds its opcode and its length in words, including the
+// operands and the instructions nested in it
+constexpr std::size_t opcodeBits = 8;
+constexpr std::size_t maximumInstructionLength = (static_cast<Word>(1) << (32 - opcodeBits)) - 1;
+
+constexpr Word makeInstructionHeader(Opcode opcode, std::size_t length)
+{
+    return static_cast<Word>(opcode) | static_cast<Word>(length) << opcodeBits;
+}
+
+constexpr Opcode getOpcode(Word header)
+{
+    return static_cast<Opcode>(header & ((static_cast<Word>(1) << opcodeBits) - 1));
+}
+
+constexpr std::size_t getInstructionLength(Word header)
+{
+    return header >> opcodeBits;
+}
+
+namespace CharacterClassFlags
+{
+constexpr Word inverted = 0x1;
+// every range is below 0x80, so UTF-8 input can be matched a byte at a time
+constexpr Word ascii = 0x2;
+}
+
+// a choice only tries the alternatives that can start with the next character, like the
+// dispatch in generated parsers; there are first sets for at most this many alternatives, and
+// the rest are always tried
+constexpr std::size_t maximumDispatchedAlternativeCount = 64;
+
+// a first set is a bitmap of the characters below 0x100, then FirstSetFlags
+constexpr std::size_t firstSetSize = 9;
+
+// a choice's first sets start with the union of its alternatives' first sets; each alternative's
+// first set is followed by the failure recorded when it's skipped: the message, then how far past
+// the choice's position the failure's input end is
+constexpr std::size_t alternativeFirstSetSize = firstSetSize + 2;
+
+namespace FirstSetFlags
+{
+constexpr Word hasNonASCII = 0x1;
+constexpr Word hasNonLatin1 = 0x2;
+}
+
+constexpr Word noMemoSlot = 0xFFFFFFFFUL;
+
+struct Rule final
+{
+    Word name; // offset into strings
+    Word code; // offset of the rule's expression
+    Word memoSlot; // noMemoSlot if the rule isn't memoized
+    Word memoizeValue; // nonzero for @memovalue rules
+};
+
+// the tables of a program, wherever they're stored; see Program and MappedImage
+struct ProgramView final
+{
+    const Word *code = nullptr;
+    std::size_t codeSize = 0;
+    const Rule *rules = nullptr;
+    std::size_t ruleCount = 0;
+    const char32_t *characters = nullptr;
+    std::size_t characterCount = 0;
+    const Word *bitmaps = nullptr;
+    std::size_t bitmapsSize = 0;
+    const Word *firstSets = nullptr;
+    std::size_t firstSetsSize = 0;
+    const char *strings = nullptr;
+    std::size_t stringsSize = 0;
+    Word memoSlotCount = 0;
+    static constexpr std::size_t noRule = static_cast<std::size_t>(-1);
+    // returns noRule if there isn't a rule with that name
+    std::size_t findRule(const std::string &name) const;
+    const char *getString(Word offset) const
+    {
+        return strings + offset;
+    }
+};
+
+struct Program final
+{
+    std::vector<Word> code;
+    std::vector<Rule> rules;
+    std::vector<char32_t> characters; // literal characters and character class range bounds
+    std::vector<Word> bitmaps; // 8 words per character class, one bit per character below 0x100
+    // a choice has the union of its alternatives' first sets, then alternativeFirstSetSize
+    // words for each alternative
+    std::vector<Word> firstSets;
+    std::vector<char> strings; // nul-terminated rule names and error messages
+    Word memoSlotCount = 0;
+    // the view is invalidated by changing the program
+    ProgramView getView() const;
+};
+
+// loads, parses, and compiles a grammar file; returns false if there were errors
+bool compileGrammar(ErrorHandler &errorHandler, const std::string &fileName, Program &program);
+}
+
+#endif /* BYTECODE_H_ */
@@ -19,10 +19,13 @@
  *
  */
 #include "code_generator.h"
+#include "bytecode.h"
+#include "error.h"
 #include "ast/visitor.h"
 #include "ast/dump_visitor.h"
 #include "ast/nonterminal.h"
 #include "ast/empty.h"
+#include "ast/cut.h"
 #include "ast/expression.h"
 #include "ast/ordered_choice.h"
 #include "ast/predicate.h"
@@ -35,6 +38,563 @@
 #include <sstream>
 #include <cassert>
 #include <cctype>
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <set>
+
+namespace
+{
+// counts the expression nodes in a rule, expanding references to the rules in inlineSizes, and
+// collects the names the rule's code can see or use
+struct InlineSizeVisitor final : public ast::Visitor
+{
+    static constexpr std::size_t unknownSize = static_cast<std::size_t>(-1);
+    const std::map<const ast::Nonterminal *, std::size_t> &inlineSizes;
+    std::size_t size = 0;
+    std::set<std::string> variableNames;
+    std::set<std::string> codeIdentifiers;
+    explicit InlineSizeVisitor(const std::map<const ast::Nonterminal *, std::size_t> &inlineSizes)
+        : inlineSizes(inlineSizes)
+    {
+    }
+    void addCodeIdentifiers(const std::string &code)
+    {
+        for(std::size_t i = 0; i < code.size();)
+        {
+            if(!std::isalpha(static_cast<unsigned char>(code[i])) && code[i] != '_')
+            {
+                i++;
+                continue;
+            }
+            std::size_t start = i;
+            while(i < code.size()
+                  && (std::isalnum(static_cast<unsigned char>(code[i])) || code[i] == '_'))
+                i++;
+            codeIdentifiers.insert(code.substr(start, i - start));
+        }
+    }
+    void add(std::size_t count)
+    {
+        if(size == unknownSize || count == unknownSize)
+            size = unknownSize;
+        else
+            size += count;
+    }
+    virtual void visitEmpty(ast::Empty *node) override
+    {
+        add(1);
+    }
+    virtual void visitCut(ast::Cut *node) override
+    {
+        add(1);
+    }
+    virtual void visitGrammar(ast::Grammar *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminal(ast::Nonterminal *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminalExpression(ast::NonterminalExpression *node) override
+    {
+        if(!node->variableName.empty())
+            variableNames.insert(node->variableName);
+        auto iter = inlineSizes.find(node->value);
+        if(iter == inlineSizes.end())
+            add(1);
+        else
+            add(std::get<1>(*iter));
+    }
+    virtual void visitOrderedChoice(ast::OrderedChoice *node) override
+    {
+        add(1);
+        node->first->visit(*this);
+        node->second->visit(*this);
+    }
+    virtual void visitFollowedByPredicate(ast::FollowedByPredicate *node) override
+    {
+        add(1);
+        node->expression->visit(*this);
+    }
+    virtual void visitNotFollowedByPredicate(ast::NotFollowedByPredicate *node) override
+    {
+        add(1);
+        node->expression->visit(*this);
+    }
+    virtual void visitCustomPredicate(ast::CustomPredicate *node) override
+    {
+        add(1);
+        addCodeIdentifiers(node->codeSnippet->code);
+    }
+    virtual void visitGreedyRepetition(ast::GreedyRepetition *node) override
+    {
+        add(1);
+        node->expression->visit(*this);
+    }
+    virtual void visitGreedyPositiveRepetition(ast::GreedyPositiveRepetition *node) override
+    {
+        add(1);
+        node->expression->visit(*this);
+    }
+    virtual void visitOptionalExpression(ast::OptionalExpression *node) override
+    {
+        add(1);
+        node->expression->visit(*this);
+    }
+    virtual void visitSequence(ast::Sequence *node) override
+    {
+        add(1);
+        node->first->visit(*this);
+        node->second->visit(*this);
+    }
+    virtual void visitTerminal(ast::Terminal *node) override
+    {
+        add(1);
+    }
+    virtual void visitLiteral(ast::Literal *node) override
+    {
+        add(1);
+    }
+    virtual void visitCharacterClass(ast::CharacterClass *node) override
+    {
+        add(1);
+        if(!node->variableName.empty())
+            variableNames.insert(node->variableName);
+    }
+    virtual void visitEOFTerminal(ast::EOFTerminal *node) override
+    {
+        add(1);
+    }
+    virtual void visitExpressionCodeSnippet(ast::ExpressionCodeSnippet *node) override
+    {
+        add(1);
+        addCodeIdentifiers(node->code);
+    }
+    virtual void visitTopLevelCodeSnippet(ast::TopLevelCodeSnippet *node) override
+    {
+        assert(false);
+    }
+    virtual void visitType(ast::Type *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentType(ast::TemplateArgumentType *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentTypeValue(ast::TemplateArgumentTypeValue *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentConstant(ast::TemplateArgumentConstant *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateVariableDeclaration(ast::TemplateVariableDeclaration *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentVariableReference(
+        ast::TemplateArgumentVariableReference *node) override
+    {
+        assert(false);
+    }
+};
+
+// finds what a rule needs for deferred actions: the expressions that run code when the accepted
+// parse is replayed, given the rules known to be replayed, and the predicates whose rules record
+// into the action tape
+struct DeferredActionsVisitor final : public ast::Visitor
+{
+    const std::set<const ast::Nonterminal *> &replayedNonterminals;
+    std::set<const ast::Expression *> replayedExpressions;
+    std::set<const ast::Expression *> recordingPredicates;
+    std::set<const ast::Nonterminal *> calledNonterminals;
+    // custom predicates, and code in other predicates, can depend on actions run while parsing
+    bool needsEagerActions = false;
+    bool hasActions = false;
+    bool isReplayed = false;
+    explicit DeferredActionsVisitor(const std::set<const ast::Nonterminal *> &replayedNonterminals)
+        : replayedNonterminals(replayedNonterminals)
+    {
+    }
+    void visitChildren(ast::Expression *node, ast::Expression *first, ast::Expression *second)
+    {
+        bool savedHasActions = hasActions;
+        bool savedIsReplayed = isReplayed;
+        hasActions = false;
+        isReplayed = false;
+        first->visit(*this);
+        if(second)
+            second->visit(*this);
+        if(isReplayed)
+            replayedExpressions.insert(node);
+        hasActions = hasActions || savedHasActions;
+        isReplayed = isReplayed || savedIsReplayed;
+    }
+    void visitPredicate(ast::Expression *node, ast::Expression *expression)
+    {
+        bool savedHasActions = hasActions;
+        bool savedIsReplayed = isReplayed;
+        hasActions = false;
+        isReplayed = false;
+        expression->visit(*this);
+        if(hasActions)
+            needsEagerActions = true;
+        if(isReplayed)
+            recordingPredicates.insert(node);
+        hasActions = savedHasActions;
+        isReplayed = savedIsReplayed;
+    }
+    void addLeaf(ast::Expression *node, bool nodeHasActions, bool nodeIsReplayed)
+    {
+        if(nodeIsReplayed)
+            replayedExpressions.insert(node);
+        hasActions = hasActions || nodeHasActions;
+        isReplayed = isReplayed || nodeIsReplayed;
+    }
+    virtual void visitEmpty(ast::Empty *node) override
+    {
+    }
+    virtual void visitCut(ast::Cut *node) override
+    {
+    }
+    virtual void visitGrammar(ast::Grammar *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminal(ast::Nonterminal *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminalExpression(ast::NonterminalExpression *node) override
+    {
+        calledNonterminals.insert(node->value);
+        bool hasVariable = !node->variableName.empty();
+        addLeaf(node, hasVariable, hasVariable || replayedNonterminals.count(node->value) != 0);
+    }
+    virtual void visitOrderedChoice(ast::OrderedChoice *node) override
+    {
+        visitChildren(node, node->first, node->second);
+    }
+    virtual void visitFollowedByPredicate(ast::FollowedByPredicate *node) override
+    {
+        visitPredicate(node, node->expression);
+    }
+    virtual void visitNotFollowedByPredicate(ast::NotFollowedByPredicate *node) override
+    {
+        visitPredicate(node, node->expression);
+    }
+    virtual void visitCustomPredicate(ast::CustomPredicate *node) override
+    {
+        needsEagerActions = true;
+    }
+    virtual void visitGreedyRepetition(ast::GreedyRepetition *node) override
+    {
+        visitChildren(node, node->expression, nullptr);
+    }
+    virtual void visitGreedyPositiveRepetition(ast::GreedyPositiveRepetition *node) override
+    {
+        visitChildren(node, node->expression, nullptr);
+    }
+    virtual void visitOptionalExpression(ast::OptionalExpression *node) override
+    {
+        visitChildren(node, node->expression, nullptr);
+    }
+    virtual void visitSequence(ast::Sequence *node) override
+    {
+        visitChildren(node, node->first, node->second);
+    }
+    virtual void visitTerminal(ast::Terminal *node) override
+    {
+    }
+    virtual void visitLiteral(ast::Literal *node) override
+    {
+    }
+    virtual void visitCharacterClass(ast::CharacterClass *node) override
+    {
+        bool hasVariable = !node->variableName.empty();
+        addLeaf(node, hasVariable, hasVariable);
+    }
+    virtual void visitEOFTerminal(ast::EOFTerminal *node) override
+    {
+    }
+    virtual void visitExpressionCodeSnippet(ast::ExpressionCodeSnippet *node) override
+    {
+        addLeaf(node, true, true);
+    }
+    virtual void visitTopLevelCodeSnippet(ast::TopLevelCodeSnippet *node) override
+    {
+        assert(false);
+    }
+    virtual void visitType(ast::Type *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentType(ast::TemplateArgumentType *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentTypeValue(ast::TemplateArgumentTypeValue *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentConstant(ast::TemplateArgumentConstant *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateVariableDeclaration(ast::TemplateVariableDeclaration *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentVariableReference(
+        ast::TemplateArgumentVariableReference *node) override
+    {
+        assert(false);
+    }
+};
+
+// collects the expressions repeated by * and + in a rule, without following nonterminals
+struct RepetitionVisitor final : public ast::Visitor
+{
+    std::vector<ast::Expression *> repeatedExpressions;
+    virtual void visitEmpty(ast::Empty *node) override
+    {
+    }
+    virtual void visitCut(ast::Cut *node) override
+    {
+    }
+    virtual void visitGrammar(ast::Grammar *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminal(ast::Nonterminal *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminalExpression(ast::NonterminalExpression *node) override
+    {
+    }
+    virtual void visitOrderedChoice(ast::OrderedChoice *node) override
+    {
+        node->first->visit(*this);
+        node->second->visit(*this);
+    }
+    virtual void visitFollowedByPredicate(ast::FollowedByPredicate *node) override
+    {
+        node->expression->visit(*this);
+    }
+    virtual void visitNotFollowedByPredicate(ast::NotFollowedByPredicate *node) override
+    {
+        node->expression->visit(*this);
+    }
+    virtual void visitCustomPredicate(ast::CustomPredicate *node) override
+    {
+    }
+    virtual void visitGreedyRepetition(ast::GreedyRepetition *node) override
+    {
+        repeatedExpressions.push_back(node->expression);
+        node->expression->visit(*this);
+    }
+    virtual void visitGreedyPositiveRepetition(ast::GreedyPositiveRepetition *node) override
+    {
+        repeatedExpressions.push_back(node->expression);
+        node->expression->visit(*this);
+    }
+    virtual void visitOptionalExpression(ast::OptionalExpression *node) override
+    {
+        node->expression->visit(*this);
+    }
+    virtual void visitSequence(ast::Sequence *node) override
+    {
+        node->first->visit(*this);
+        node->second->visit(*this);
+    }
+    virtual void visitTerminal(ast::Terminal *node) override
+    {
+    }
+    virtual void visitLiteral(ast::Literal *node) override
+    {
+    }
+    virtual void visitCharacterClass(ast::CharacterClass *node) override
+    {
+    }
+    virtual void visitEOFTerminal(ast::EOFTerminal *node) override
+    {
+    }
+    virtual void visitExpressionCodeSnippet(ast::ExpressionCodeSnippet *node) override
+    {
+    }
+    virtual void visitTopLevelCodeSnippet(ast::TopLevelCodeSnippet *node) override
+    {
+        assert(false);
+    }
+    virtual void visitType(ast::Type *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentType(ast::TemplateArgumentType *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentTypeValue(ast::TemplateArgumentTypeValue *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentConstant(ast::TemplateArgumentConstant *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateVariableDeclaration(ast::TemplateVariableDeclaration *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentVariableReference(
+        ast::TemplateArgumentVariableReference *node) override
+    {
+        assert(false);
+    }
+};
+
+// works out the failure an expression reports when the next character isn't in its first set,
+// so a choice can record it for an alternative it skips; the failure is the last one recorded
+// among those reaching furthest, like makeFail keeps. isKnown is cleared when that depends on
+// more than the grammar: predicates and cuts, or rules reached again through recursion
+struct SkippedFailureVisitor final : public ast::Visitor
+{
+    bool isKnown = true;
+    bool fails = false;
+    // the terminal, literal, character class or EOF that reports the failure
+    const ast::Expression *failure = nullptr;
+    // how far past the starting position the failure's input end is
+    std::size_t failureEndOffset = 0;
+    std::set<const ast::Nonterminal *> visitingNonterminals;
+    void addFailure(const ast::Expression *node, std::size_t endOffset)
+    {
+        fails = true;
+        if(!failure || endOffset >= failureEndOffset)
+        {
+            failure = node;
+            failureEndOffset = endOffset;
+        }
+    }
+    virtual void visitEmpty(ast::Empty *node) override
+    {
+        fails = false;
+    }
+    virtual void visitCut(ast::Cut *node) override
+    {
+        isKnown = false;
+    }
+    virtual void visitGrammar(ast::Grammar *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminal(ast::Nonterminal *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminalExpression(ast::NonterminalExpression *node) override
+    {
+        if(!visitingNonterminals.insert(node->value).second)
+        {
+            isKnown = false;
+            return;
+        }
+        node->value->expression->visit(*this);
+        visitingNonterminals.erase(node->value);
+    }
+    virtual void visitOrderedChoice(ast::OrderedChoice *node) override
+    {
+        node->first->visit(*this);
+        if(isKnown && fails)
+            node->second->visit(*this);
+    }
+    virtual void visitFollowedByPredicate(ast::FollowedByPredicate *node) override
+    {
+        isKnown = false;
+    }
+    virtual void visitNotFollowedByPredicate(ast::NotFollowedByPredicate *node) override
+    {
+        isKnown = false;
+    }
+    virtual void visitCustomPredicate(ast::CustomPredicate *node) override
+    {
+        isKnown = false;
+    }
+    virtual void visitGreedyRepetition(ast::GreedyRepetition *node) override
+    {
+        node->expression->visit(*this);
+        fails = false;
+    }
+    virtual void visitGreedyPositiveRepetition(ast::GreedyPositiveRepetition *node) override
+    {
+        node->expression->visit(*this);
+    }
+    virtual void visitOptionalExpression(ast::OptionalExpression *node) override
+    {
+        node->expression->visit(*this);
+        fails = false;
+    }
+    virtual void visitSequence(ast::Sequence *node) override
+    {
+        node->first->visit(*this);
+        if(isKnown && !fails)
+            node->second->visit(*this);
+    }
+    virtual void visitTerminal(ast::Terminal *node) override
+    {
+        addFailure(node, 1);
+    }
+    virtual void visitLiteral(ast::Literal *node) override
+    {
+        addFailure(node, 1);
+    }
+    virtual void visitCharacterClass(ast::CharacterClass *node) override
+    {
+        addFailure(node, 1);
+    }
+    virtual void visitEOFTerminal(ast::EOFTerminal *node) override
+    {
+        addFailure(node, 0);
+    }
+    virtual void visitExpressionCodeSnippet(ast::ExpressionCodeSnippet *node) override
+    {
+        fails = false;
+    }
+    virtual void visitTopLevelCodeSnippet(ast::TopLevelCodeSnippet *node) override
+    {
+        assert(false);
+    }
+    virtual void visitType(ast::Type *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentType(ast::TemplateArgumentType *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentTypeValue(ast::TemplateArgumentTypeValue *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentConstant(ast::TemplateArgumentConstant *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateVariableDeclaration(ast::TemplateVariableDeclaration *node) override
+    {
+        assert(false);
+    }
+    virtual void visitTemplateArgumentVariableReference(
+        ast::TemplateArgumentVariableReference *node) override
+    {
+        assert(false);
+    }
+};
+}
 
 struct CodeGenerator::CPlusPlus11 final : public CodeGenerator, public ast::Visitor
 {
@@ -45,269 +605,1151 @@ struct CodeGenerator::CPlusPlus11 final : public CodeGenerator, public ast::Visi
     std::string headerFileName;
     std::string headerFileNameFromSourceFile;
     std::string sourceFileName;
+    const CPlusPlus11Settings settings;
     const std::size_t indentSize = 4;
     const std::size_t tabSize = 0;
     const ast::Nonterminal *nonterminal = nullptr;
     enum class State
     {
-        DeclareLocals,
-        ParseAndEvaluateFunction,
+        DeclareLocals,
+        ParseAndEvaluateFunction,
+        ReplayFunction,
+    };
+    State state = State::ParseAndEvaluateFunction;
+    bool needsIsRequiredForSuccess = false;
+    bool hasCuts = false;
+    // whether a scan loop calls findFirstOf, so the parser needs it and its vector kernels
+    bool usesFindFirstOf = false;
+    bool memoWriteBack = false;
+    std::size_t backtrackPointCount = 0;
+    std::string choiceBacktrackPointName;
+    std::size_t choiceDispatchCount = 0;
+    std::map<const ast::Nonterminal *, std::size_t> memoProfileIndexes;
+    std::map<const ast::Nonterminal *, std::size_t> ruleProfileIndexes;
+    std::set<const ast::Nonterminal *> inlinedNonterminals;
+    struct RuleNames final
+    {
+        std::set<std::string> declaredNames;
+        std::set<std::string> codeIdentifiers;
+    };
+    std::map<const ast::Nonterminal *, RuleNames> ruleNames;
+    // the grammar's variables and template arguments in scope where code is being generated
+    std::set<std::string> visibleNames;
+    // for --defer-actions: the rules that only record the action tape while parsing, those of
+    // them with a replay function, and the expressions that run code when replayed
+    std::set<const ast::Nonterminal *> deferredNonterminals;
+    std::set<const ast::Nonterminal *> replayedNonterminals;
+    std::set<const ast::Expression *> replayedExpressions;
+    std::set<const ast::Expression *> recordingPredicates;
+    bool isRecordingActionTape = false;
+    std::size_t actionTapeMarkCount = 0;
+    CPlusPlus11(std::ostream &finalSourceFile,
+                std::ostream &finalHeaderFile,
+                std::string headerFileName,
+                std::string headerFileNameFromSourceFile,
+                std::string sourceFileName,
+                CPlusPlus11Settings settings)
+        : finalSourceFile(finalSourceFile),
+          finalHeaderFile(finalHeaderFile),
+          headerFileName(std::move(headerFileName)),
+          headerFileNameFromSourceFile(std::move(headerFileNameFromSourceFile)),
+          sourceFileName(std::move(sourceFileName)),
+          settings(std::move(settings))
+    {
+    }
+    static std::string escapeChar(char32_t ch)
+    {
+        return ast::DumpVisitor::escapeCharacter(ch);
+    }
+    static std::string escapeCharForCharacterClass(char32_t ch)
+    {
+        if(ch == '-' || ch == '^' || ch == ']')
+            return std::string("\\") + static_cast<char>(ch);
+        return ast::DumpVisitor::escapeCharacter(ch);
+    }
+    static std::string getCharName(char32_t ch)
+    {
+        switch(ch)
+        {
+        case '\n':
+            return "end of line ('\\n')";
+        case '\r':
+            return "end of line ('\\r')";
+        case '\t':
+            return "tab (\\t)";
+        case ' ':
+            return "space (' ')";
+        default:
+            if(ch <= 0x20 || ch >= 0x7F)
+            {
+                std::ostringstream ss;
+                ss << "character with code " << static_cast<unsigned long>(ch) << " (0x" << std::hex
+                   << std::uppercase << static_cast<unsigned long>(ch) << ")";
+                return ss.str();
+            }
+            return std::string(1, static_cast<char>(ch));
+        }
+    }
+    static std::string getCharacterClassMatchFailMessage(const ast::CharacterClass *characterClass)
+    {
+        std::ostringstream ss;
+        if(!characterClass->inverted)
+            ss << "missing ";
+        if(characterClass->characterRanges.matchesClassifier(
+               ast::CharacterClass::CharacterRanges::DecimalDigitClassifier()))
+        {
+            ss << "decimal digit";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::OctalDigitClassifier()))
+        {
+            ss << "octal digit";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::HexDigitClassifier()))
+        {
+            ss << "hexadecimal digit";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LowercaseHexDigitClassifier()))
+        {
+            ss << "lowercase hexadecimal digit";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::UppercaseHexDigitClassifier()))
+        {
+            ss << "uppercase hexadecimal digit";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LetterClassifier()))
+        {
+            ss << "letter";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LowercaseLetterClassifier()))
+        {
+            ss << "lowercase letter";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::UppercaseLetterClassifier()))
+        {
+            ss << "uppercase letter";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LetterOrDigitClassifier()))
+        {
+            ss << "letter or digit";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::UppercaseLetterOrUnderlineClassifier()))
+        {
+            ss << "uppercase letter or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LowercaseLetterOrUnderlineClassifier()))
+        {
+            ss << "lowercase letter or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LetterOrUnderlineClassifier()))
+        {
+            ss << "letter or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::DigitOrUnderlineClassifier()))
+        {
+            ss << "digit or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LetterDigitOrUnderlineClassifier()))
+        {
+            ss << "letter, digit, or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::
+                        UppercaseLetterDollarOrUnderlineClassifier()))
+        {
+            ss << "uppercase letter, $, or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::
+                        LowercaseLetterDollarOrUnderlineClassifier()))
+        {
+            ss << "lowercase letter, $, or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LetterDollarOrUnderlineClassifier()))
+        {
+            ss << "letter, $, or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LetterDigitDollarOrUnderlineClassifier()))
+        {
+            ss << "letter, digit, $, or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::DigitDollarOrUnderlineClassifier()))
+        {
+            ss << "digit, $, or _";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::SpaceOrTabClassifier()))
+        {
+            ss << "space or tab";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::SpaceTabOrLineEndingClassifier()))
+        {
+            ss << "space, tab, or line ending";
+        }
+        else if(characterClass->characterRanges.matchesClassifier(
+                    ast::CharacterClass::CharacterRanges::LineEndingClassifier()))
+        {
+            ss << "line ending";
+        }
+        else
+        {
+            std::uint_fast32_t totalCharCount = 0;
+            const std::size_t firstCharsSize = 5;
+            char32_t firstChars[firstCharsSize];
+            std::size_t firstCharsUsed = 0;
+            for(const auto &range : characterClass->characterRanges.ranges)
+            {
+                assert(!range.empty());
+                totalCharCount += range.max - range.min + 1;
+                for(std::uint_fast32_t i = range.min; i <= range.max; i++)
+                {
+                    if(firstCharsUsed < firstCharsSize)
+                    {
+                        firstChars[firstCharsUsed++] = i;
+                    }
+                }
+            }
+            if(totalCharCount == 1)
+            {
+                assert(firstCharsUsed == 1);
+                ss << getCharName(firstChars[0]);
+            }
+            else if(totalCharCount == 2)
+            {
+                assert(firstCharsUsed == 2);
+                ss << getCharName(firstChars[0]) << " or " << getCharName(firstChars[1]);
+            }
+            else if(totalCharCount > 1 && totalCharCount <= firstCharsSize)
+            {
+                assert(firstCharsUsed == totalCharCount);
+                ss << getCharName(firstChars[0]);
+                for(std::size_t i = 1; i < totalCharCount; i++)
+                {
+                    ss << ", ";
+                    if(i + 1 == totalCharCount)
+                        ss << "or ";
+                    ss << getCharName(firstChars[i]);
+                }
+            }
+            else
+            {
+                ss << "[";
+                for(const auto &range : characterClass->characterRanges.ranges)
+                {
+                    if(range.min == range.max)
+                    {
+                        ss << escapeCharForCharacterClass(range.min);
+                    }
+                    else
+                    {
+                        ss << escapeCharForCharacterClass(range.min);
+                        ss << '-';
+                        ss << escapeCharForCharacterClass(range.max);
+                    }
+                }
+                ss << "]";
+            }
+        }
+        if(characterClass->inverted)
+            ss << " not allowed here";
+        return ss.str();
+    }
+    // the failure a choice records for an alternative it skips because the next character isn't
+    // in the alternative's first set
+    struct SkippedFailure final
+    {
+        // alternatives whose failure depends on more than the grammar are never skipped
+        bool canSkip = false;
+        std::string message;
+        std::size_t endOffset = 0;
     };
-    State state = State::ParseAndEvaluateFunction;
-    bool needsIsRequiredForSuccess = false;
-    CPlusPlus11(std::ostream &finalSourceFile,
-                std::ostream &finalHeaderFile,
-                std::string headerFileName,
-                std::string headerFileNameFromSourceFile,
-                std::string sourceFileName)
-        : finalSourceFile(finalSourceFile),
-          finalHeaderFile(finalHeaderFile),
-          headerFileName(std::move(headerFileName)),
-          headerFileNameFromSourceFile(std::move(headerFileNameFromSourceFile)),
-          sourceFileName(std::move(sourceFileName))
+    static SkippedFailure getSkippedFailure(ast::Expression *alternative)
     {
+        SkippedFailure retval;
+        if(alternative->canAcceptEmptyString())
+            return retval;
+        SkippedFailureVisitor visitor;
+        alternative->visit(visitor);
+        if(!visitor.isKnown || !visitor.fails || !visitor.failure)
+            return retval;
+        retval.canSkip = true;
+        retval.endOffset = visitor.failureEndOffset;
+        if(auto terminal = dynamic_cast<const ast::Terminal *>(visitor.failure))
+            retval.message = "missing " + getCharName(terminal->value);
+        else if(auto literal = dynamic_cast<const ast::Literal *>(visitor.failure))
+            retval.message = "missing " + getCharName(literal->value.front());
+        else if(auto characterClass = dynamic_cast<const ast::CharacterClass *>(visitor.failure))
+            retval.message = getCharacterClassMatchFailMessage(characterClass);
+        else
+            retval.message = "expected end of file";
+        return retval;
     }
-    static std::string escapeChar(char32_t ch)
+    static std::string escapeString(const std::string &str)
     {
-        return ast::DumpVisitor::escapeCharacter(ch);
+        std::string retval;
+        retval.reserve(str.size() * 5 / 4);
+        for(unsigned char ch : str)
+        {
+            retval += escapeChar(ch);
+        }
+        return retval;
     }
-    static std::string escapeCharForCharacterClass(char32_t ch)
+    static std::string encodeUTF8(char32_t ch)
     {
-        if(ch == '-' || ch == '^' || ch == ']')
-            return std::string("\\") + static_cast<char>(ch);
-        return ast::DumpVisitor::escapeCharacter(ch);
+        std::string retval;
+        if(ch < 0x80)
+        {
+            retval += static_cast<char>(ch);
+        }
+        else if(ch < 0x800)
+        {
+            retval += static_cast<char>(0xC0 | (ch >> 6));
+            retval += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else if(ch < 0x10000UL)
+        {
+            retval += static_cast<char>(0xE0 | (ch >> 12));
+            retval += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            retval += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        else
+        {
+            retval += static_cast<char>(0xF0 | (ch >> 18));
+            retval += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+            retval += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            retval += static_cast<char>(0x80 | (ch & 0x3F));
+        }
+        return retval;
     }
-    static std::string getCharName(char32_t ch)
+    // a string literal with the same encoding as the parser's source
+    std::string makeSourceStringLiteral(const std::u32string &value) const
     {
-        switch(ch)
+        if(!settings.utf8Input)
         {
-        case '\n':
-            return "end of line ('\\n')";
-        case '\r':
-            return "end of line ('\\r')";
-        case '\t':
-            return "tab (\\t)";
-        case ' ':
-            return "space (' ')";
-        default:
-            if(ch <= 0x20 || ch >= 0x7F)
+            std::string retval = "U\"";
+            for(char32_t ch : value)
+                retval += escapeChar(ch);
+            return retval + "\"";
+        }
+        std::string bytes;
+        for(char32_t ch : value)
+            bytes += encodeUTF8(ch);
+        std::string retval = "\"";
+        for(unsigned char byte : bytes)
+        {
+            if(byte >= 0x80)
             {
                 std::ostringstream ss;
-                ss << "character with code " << static_cast<unsigned long>(ch) << " (0x" << std::hex
-                   << std::uppercase << static_cast<unsigned long>(ch) << ")";
-                return ss.str();
+                ss << "\\" << std::oct << static_cast<unsigned>(byte);
+                retval += ss.str();
             }
-            return std::string(1, static_cast<char>(ch));
+            else
+            {
+                retval += escapeChar(byte);
+            }
+        }
+        return retval + "\"";
+    }
+    static std::string translateName(const char *prefix, std::string name, const char *suffix)
+    {
+        assert(!name.empty());
+        name[0] = std::toupper(name[0]);
+        return prefix + std::move(name) + suffix;
+    }
+    static std::string makeResultVariableName(std::string name)
+    {
+        return translateName("result", std::move(name), "");
+    }
+    static std::string makeValueVariableName(std::string name)
+    {
+        return translateName("value", std::move(name), "");
+    }
+    static std::string makeHasValueVariableName(std::string name)
+    {
+        return translateName("hasValue", std::move(name), "");
+    }
+    static std::string makeResultSubscript(const ast::Nonterminal *nonterminal)
+    {
+        std::string retval;
+        for(auto templateArgument : nonterminal->templateArguments)
+        {
+            retval += "[static_cast<std::size_t>(" + templateArgument->name + ")]";
+        }
+        return retval;
+    }
+    void writeCharacterClassMatch(const ast::CharacterClass::CharacterRanges &characterRanges)
+    {
+        constexpr std::size_t maximumComparedRangeCount = 3;
+        constexpr char32_t bitmapSize = 0x100;
+        auto writeComparisons = [this](const std::vector<ast::CharacterClass::CharacterRange> &ranges)
+        {
+            auto seperator = "";
+            for(const auto &range : ranges)
+            {
+                sourceFile << seperator;
+                seperator = " || ";
+                if(range.min == range.max)
+                {
+                    sourceFile << R"(character__ == U')" << escapeChar(range.min) << R"(')";
+                }
+                else
+                {
+                    if(ranges.size() > 1)
+                        sourceFile << "(";
+                    sourceFile << R"(character__ >= U')" << escapeChar(range.min)
+                               << R"(' && character__ <= U')" << escapeChar(range.max) << R"(')";
+                    if(ranges.size() > 1)
+                        sourceFile << ")";
+                }
+            }
+        };
+        const auto &ranges = characterRanges.ranges;
+        if(ranges.empty())
+        {
+            sourceFile << R"(    bool matches = false;
+)";
+            return;
+        }
+        if(ranges.size() <= maximumComparedRangeCount)
+        {
+            sourceFile << R"(    bool matches = )";
+            writeComparisons(ranges);
+            sourceFile << R"(;
+)";
+            return;
+        }
+        unsigned char bitmap[bitmapSize / 8] = {};
+        std::vector<ast::CharacterClass::CharacterRange> highRanges;
+        for(const auto &range : ranges)
+        {
+            for(char32_t ch = range.min; ch <= range.max && ch < bitmapSize; ch++)
+                bitmap[ch / 8] |= 1 << (ch % 8);
+            if(range.max >= bitmapSize)
+                highRanges.push_back(
+                    ast::CharacterClass::CharacterRange(std::max(range.min, bitmapSize), range.max));
+        }
+        sourceFile << R"(    static const unsigned char bitmap__[0x20] = {
+)";
+        for(std::size_t i = 0; i < sizeof(bitmap); i += 8)
+        {
+            sourceFile << R"(        )";
+            for(std::size_t j = i; j < i + 8; j++)
+            {
+                sourceFile << "0x" << std::hex << std::uppercase << (bitmap[j] >> 4)
+                           << (bitmap[j] & 0xF) << std::dec << ",";
+                if(j + 1 < i + 8)
+                    sourceFile << " ";
+            }
+            sourceFile << "\n";
+        }
+        sourceFile << R"(    };
+)";
+        if(highRanges.empty())
+        {
+            sourceFile << R"(    bool matches = character__ < 0x100 && ((bitmap__[character__ >> 3] >> (character__ & 7)) & 1);
+)";
+            return;
+        }
+        if(highRanges.size() > maximumComparedRangeCount)
+        {
+            sourceFile << R"(    static const char32_t ranges__[] = {
+)";
+            for(const auto &range : highRanges)
+            {
+                sourceFile << R"(        )" << std::hex << std::uppercase << "0x"
+                           << static_cast<std::uint_least32_t>(range.min) << "UL, 0x"
+                           << static_cast<std::uint_least32_t>(range.max) << std::dec << "UL,\n";
+            }
+            sourceFile << R"(    };
+)";
+        }
+        sourceFile << R"(    bool matches;
+    if(character__ < 0x100)
+        matches = (bitmap__[character__ >> 3] >> (character__ & 7)) & 1;
+    else
+        matches = )";
+        if(highRanges.size() > maximumComparedRangeCount)
+        {
+            sourceFile << R"(isCharacterInRanges(ranges__, )" << highRanges.size()
+                       << R"(, character__))";
+        }
+        else
+        {
+            writeComparisons(highRanges);
+        }
+        sourceFile << R"(;
+)";
+    }
+    void writeFindFirstOf()
+    {
+        std::string charType = settings.utf8Input ? "char" : "char32_t";
+        std::string elementSize = settings.utf8Input ? "8" : "32";
+        std::string elementBytes = settings.utf8Input ? "" : " / 4";
+        std::string setArgument =
+            settings.utf8Input ? "characters[i]" : "static_cast<int>(characters[i])";
+        sourceFile << R"(#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+namespace
+{
+)";
+        for(int avx2 = 0; avx2 < 2; avx2++)
+        {
+            std::string vector = avx2 ? "__m256i" : "__m128i";
+            std::string prefix = avx2 ? "_mm256_" : "_mm_";
+            std::string suffix = avx2 ? "si256" : "si128";
+            std::string blockSize = avx2 ? "32" : "16";
+            std::string signature = std::string(R"(__attribute__((target(")")
+                                    + (avx2 ? "avx2" : "sse2") + R"("))) std::size_t findFirstOf)"
+                                    + (avx2 ? "AVX2" : "SSE2") + "(";
+            std::string continuation(signature.size(), '`');
+            sourceFile << signature << R"(const )" << charType << R"( *source,
+)" << continuation << R"(std::size_t position,
+)" << continuation << R"(std::size_t sourceSize,
+)" << continuation << R"(const )" << charType << R"( *characters,
+)" << continuation << R"(std::size_t characterCount)
+{
+    )" << vector << R"( sets[4];
+    for(std::size_t i = 0; i < characterCount; i++)
+        sets[i] = )" << prefix << R"(set1_epi)" << elementSize << R"(()" << setArgument
+                       << R"();
+    constexpr std::size_t blockSize = )" << blockSize << R"( / sizeof()" << charType
+                       << R"();
+    for(; sourceSize - position >= blockSize; position += blockSize)
+    {
+        )" << vector << R"( block = )" << prefix << R"(loadu_)" << suffix
+                       << R"((reinterpret_cast<const )" << vector << R"( *>(source + position));
+        )" << vector << R"( found = )" << prefix << R"(cmpeq_epi)" << elementSize
+                       << R"((block, sets[0]);
+        for(std::size_t i = 1; i < characterCount; i++)
+            found = )" << prefix << R"(or_)" << suffix << R"((found, )" << prefix
+                       << R"(cmpeq_epi)" << elementSize << R"((block, sets[i]));
+        unsigned mask = static_cast<unsigned>()" << prefix << R"(movemask_epi8(found));
+        if(mask != 0)
+            return position + static_cast<std::size_t>(__builtin_ctz(mask)))"
+                       << elementBytes << R"(;
+    }
+    return position;
+}
+
+)";
+        }
+        sourceFile << R"(}
+#endif
+
+std::size_t Parser::findFirstOf(std::size_t position,
+````````````````````````````````const )" << charType << R"( *characters,
+````````````````````````````````std::size_t characterCount) const
+{
+    assert(characterCount > 0 && characterCount <= 4);
+    // a borrowed empty source can be null
+    if(position >= sourceSize)
+        return sourceSize;
+    const )" << charType << R"( *source = this->source.get();
+)";
+        if(settings.utf8Input)
+        {
+            sourceFile << R"(    if(characterCount == 1)
+    {
+        auto found = static_cast<const char *>(
+            std::memchr(source + position, characters[0], sourceSize - position));
+        return found ? static_cast<std::size_t>(found - source) : sourceSize;
+    }
+)";
+        }
+        sourceFile << R"(#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const int vectorLevel = []()
+    {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            return 2;
+        if(__builtin_cpu_supports("sse2"))
+            return 1;
+        return 0;
+    }();
+    if(vectorLevel == 2)
+        position = findFirstOfAVX2(source, position, sourceSize, characters, characterCount);
+    else if(vectorLevel == 1)
+        position = findFirstOfSSE2(source, position, sourceSize, characters, characterCount);
+#endif
+    for(; position < sourceSize; position++)
+    {
+        for(std::size_t i = 0; i < characterCount; i++)
+        {
+            if(source[position] == characters[i])
+                return position;
         }
     }
-    static std::string getCharacterClassMatchFailMessage(const ast::CharacterClass *characterClass)
+    return sourceSize;
+}
+
+)";
+    }
+    // (!"literal" [^])* searches for the literal's first character; failures inside the
+    // predicate are reported when the repetition isn't required for success, so that case
+    // keeps the generic loop, which the caller writes into the else branch
+    // the literal a (!"literal" [^])* repetition searches for, or an empty string if expression
+    // isn't of that form
+    std::u32string getScanLiteral(ast::Expression *expression) const
     {
-        std::ostringstream ss;
-        if(!characterClass->inverted)
-            ss << "missing ";
-        if(characterClass->characterRanges.matchesClassifier(
-               ast::CharacterClass::CharacterRanges::DecimalDigitClassifier()))
+        auto sequence = dynamic_cast<ast::Sequence *>(expression);
+        if(!sequence)
+            return std::u32string();
+        auto predicate = dynamic_cast<ast::NotFollowedByPredicate *>(sequence->first);
+        auto anyCharacter = dynamic_cast<ast::CharacterClass *>(sequence->second);
+        if(!predicate || !anyCharacter || !anyCharacter->inverted
+           || !anyCharacter->characterRanges.ranges.empty() || !anyCharacter->variableName.empty())
+            return std::u32string();
+        std::u32string literal;
+        if(auto terminal = dynamic_cast<ast::Terminal *>(predicate->expression))
+            literal = std::u32string(1, terminal->value);
+        else if(auto literalNode = dynamic_cast<ast::Literal *>(predicate->expression))
+            literal = literalNode->value;
+        if(!literal.empty() && settings.utf8Input && literal[0] >= 0x80)
+            return std::u32string();
+        return literal;
+    }
+    // the characters that stop a repetition of expression when it's scanned with findFirstOf,
+    // or an empty string if it isn't
+    std::u32string getScanStopCharacters(ast::Expression *expression) const
+    {
+        auto characterClass = dynamic_cast<ast::CharacterClass *>(expression);
+        if(!characterClass || !characterClass->variableName.empty() || !characterClass->inverted)
+            return std::u32string();
+        const auto &ranges = characterClass->characterRanges.ranges;
+        // decoding never consumes an ASCII byte as part of another character
+        if(settings.utf8Input && !ranges.empty() && ranges.back().max >= 0x80)
+            return std::u32string();
+        // the generated findFirstOf compares against at most this many characters
+        constexpr std::size_t maximumScanCharacterCount = 4;
+        std::u32string stopCharacters;
+        for(const auto &range : ranges)
         {
-            ss << "decimal digit";
+            if(range.max - range.min >= maximumScanCharacterCount - stopCharacters.size())
+                return std::u32string();
+            for(char32_t ch = range.min; ch <= range.max; ch++)
+                stopCharacters += ch;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::OctalDigitClassifier()))
+        return stopCharacters;
+    }
+    bool beginLiteralScanRepetition(ast::Expression *expression, bool isPositive)
+    {
+        std::u32string literal = getScanLiteral(expression);
+        if(literal.empty())
+            return false;
+        needsIsRequiredForSuccess = true;
+        std::size_t size = literal.size();
+        if(settings.utf8Input)
         {
-            ss << "octal digit";
+            size = 0;
+            for(char32_t ch : literal)
+                size += encodeUTF8(ch).size();
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::HexDigitClassifier()))
+        sourceFile << R"(if(isRequiredForSuccess__)
+{
+    std::size_t scanLocation__ = startLocation__;
+    while(true)
+    {
+        scanLocation__ = this->findFirstOf(scanLocation__, )"
+                   << makeSourceStringLiteral(literal.substr(0, 1)) << R"(, 1);
+        if(scanLocation__ >= this->sourceSize)
         {
-            ss << "hexadecimal digit";
+            ruleResult__ = this->makeFail(this->sourceSize, "unexpected end of input", isRequiredForSuccess__);
+            break;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LowercaseHexDigitClassifier()))
+)";
+        if(size > 1)
         {
-            ss << "lowercase hexadecimal digit";
+            sourceFile << R"(        if(this->sourceSize - scanLocation__ >= )" << size << R"(
+        ```&& std::memcmp(this->source.get() + scanLocation__, )"
+                       << makeSourceStringLiteral(literal) << R"(, )" << size
+                       << R"( * sizeof(*this->source.get())) == 0)
+        {
+            ruleResult__ = this->makeFail(scanLocation__, "not allowed here", isRequiredForSuccess__);
+            break;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::UppercaseHexDigitClassifier()))
+        scanLocation__++;
+)";
+        }
+        else
         {
-            ss << "uppercase hexadecimal digit";
+            sourceFile << R"(        ruleResult__ = this->makeFail(scanLocation__, "not allowed here", isRequiredForSuccess__);
+        break;
+)";
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LetterClassifier()))
+        sourceFile << R"(    }
+)";
+        if(isPositive)
         {
-            ss << "letter";
+            sourceFile << R"(    if(ruleResult__.location != startLocation__)
+        ruleResult__ = this->makeSuccess(ruleResult__.location, ruleResult__.endLocation);
+)";
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LowercaseLetterClassifier()))
+        else
         {
-            ss << "lowercase letter";
+            sourceFile << R"(    ruleResult__ = this->makeSuccess(ruleResult__.location, ruleResult__.endLocation);
+)";
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::UppercaseLetterClassifier()))
+        sourceFile << R"(}
+else
+{
+@+)";
+        return true;
+    }
+    // repetitions of a single character class or terminal scan the input directly instead of
+    // looping over the generic single-character match; returns false if not applicable
+    bool writeCharacterRepetition(ast::Expression *expression, bool isPositive)
+    {
+        ast::CharacterClass::CharacterRanges characterRanges;
+        bool inverted = false;
+        std::string matchFailMessage;
+        std::string endOfInputMessage = "unexpected end of input";
+        if(auto characterClass = dynamic_cast<ast::CharacterClass *>(expression))
         {
-            ss << "uppercase letter";
+            if(!characterClass->variableName.empty())
+                return false;
+            characterRanges = characterClass->characterRanges;
+            inverted = characterClass->inverted;
+            matchFailMessage = getCharacterClassMatchFailMessage(characterClass);
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LetterOrDigitClassifier()))
+        else if(auto terminal = dynamic_cast<ast::Terminal *>(expression))
         {
-            ss << "letter or digit";
+            if(settings.utf8Input && terminal->value >= 0x80)
+                return false;
+            characterRanges.ranges.push_back(ast::CharacterClass::CharacterRange(terminal->value));
+            matchFailMessage = "missing " + getCharName(terminal->value);
+            endOfInputMessage = matchFailMessage;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::UppercaseLetterOrUnderlineClassifier()))
+        else
         {
-            ss << "uppercase letter or _";
+            return false;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LowercaseLetterOrUnderlineClassifier()))
+        needsIsRequiredForSuccess = true;
+        const auto &ranges = characterRanges.ranges;
+        bool isASCII = ranges.empty() || ranges.back().max < 0x80;
+        std::u32string stopCharacters = getScanStopCharacters(expression);
+        if(!stopCharacters.empty())
         {
-            ss << "lowercase letter or _";
+            sourceFile << R"({
+    std::size_t scanLocation__ = this->findFirstOf(startLocation__, )"
+                       << makeSourceStringLiteral(stopCharacters) << R"(, )"
+                       << stopCharacters.size() << R"();
+    if(scanLocation__ < this->sourceSize)
+        ruleResult__ = this->makeFail(scanLocation__, scanLocation__ + 1, ")"
+                       << escapeString(matchFailMessage) << R"(", isRequiredForSuccess__);
+    else
+        ruleResult__ = this->makeFail(this->sourceSize, ")" << escapeString(endOfInputMessage)
+                       << R"(", isRequiredForSuccess__);
+}
+)";
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LetterOrUnderlineClassifier()))
+        else
         {
-            ss << "letter or _";
+            std::string nextLocation = "scanLocation__ + 1";
+            sourceFile << R"({
+    std::size_t scanLocation__ = startLocation__;
+    while(true)
+    {
+        if(scanLocation__ >= this->sourceSize)
+        {
+            ruleResult__ = this->makeFail(scanLocation__, ")"
+                       << escapeString(endOfInputMessage) << R"(", isRequiredForSuccess__);
+            break;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::DigitOrUnderlineClassifier()))
+)";
+            if(settings.utf8Input && isASCII && !ranges.empty())
+            {
+                // non-ASCII bytes never match an ASCII class, so scan bytes
+                sourceFile << R"(        char32_t character__ = static_cast<unsigned char>(this->source.get()[scanLocation__]);
+)";
+            }
+            else if(settings.utf8Input && !isASCII)
+            {
+                nextLocation = "nextLocation__";
+                sourceFile << R"(        std::size_t nextLocation__ = scanLocation__;
+        char32_t character__ = this->decodeUTF8(this->source.get(), this->sourceSize, nextLocation__);
+)";
+            }
+            else if(!ranges.empty())
+            {
+                sourceFile << R"(        char32_t character__ = this->source.get()[scanLocation__];
+)";
+            }
+            sourceFile << R"(@+)";
+            writeCharacterClassMatch(characterRanges);
+            sourceFile << R"(@-        if()" << (inverted ? "" : "!") << R"(matches)
         {
-            ss << "digit or _";
+            ruleResult__ = this->makeFail(scanLocation__, )" << nextLocation << R"(, ")"
+                       << escapeString(matchFailMessage) << R"(", isRequiredForSuccess__);
+            break;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LetterDigitOrUnderlineClassifier()))
+        scanLocation__ = )" << nextLocation << R"(;
+    }
+}
+)";
+        }
+        if(isPositive)
         {
-            ss << "letter, digit, or _";
+            sourceFile << R"(if(ruleResult__.location != startLocation__)
+    ruleResult__ = this->makeSuccess(ruleResult__.location, ruleResult__.endLocation);
+)";
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::
-                        UppercaseLetterDollarOrUnderlineClassifier()))
+        else
         {
-            ss << "uppercase letter, $, or _";
+            sourceFile << R"(ruleResult__ = this->makeSuccess(ruleResult__.location, ruleResult__.endLocation);
+)";
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::
-                        LowercaseLetterDollarOrUnderlineClassifier()))
+        return true;
+    }
+    // a char rule that's just a character class returns the matched character
+    void writeCharacterRuleReturnValue(const ast::Nonterminal *nonterminal)
+    {
+        if(nonterminal->type->name == "char")
         {
-            ss << "lowercase letter, $, or _";
+            if(auto characterClass = dynamic_cast<ast::CharacterClass *>(nonterminal->expression))
+            {
+                // replaying only happens after the rule matched
+                if(characterClass->variableName.empty() && state == State::ReplayFunction
+                   && settings.utf8Input)
+                {
+                    sourceFile << R"({
+    std::size_t characterLocation__ = startLocation__;
+    returnValue__ = this->decodeUTF8(this->source.get(), this->sourceSize, characterLocation__);
+}
+)";
+                }
+                else if(characterClass->variableName.empty() && state == State::ReplayFunction)
+                {
+                    sourceFile << R"(returnValue__ = this->source.get()[startLocation__];
+)";
+                }
+                else if(characterClass->variableName.empty() && settings.utf8Input)
+                {
+                    sourceFile << R"(if(ruleResult__.success())
+{
+    std::size_t location__ = startLocation__;
+    returnValue__ = this->decodeUTF8(this->source.get(), this->sourceSize, location__);
+}
+)";
+                }
+                else if(characterClass->variableName.empty())
+                {
+                    sourceFile << R"(if(ruleResult__.success())
+    returnValue__ = this->source.get()[startLocation__];
+)";
+                }
+            }
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LetterDollarOrUnderlineClassifier()))
+    }
+    static constexpr std::size_t unknownLength = static_cast<std::size_t>(-1);
+    // the length of every match of expression if known from the grammar, otherwise unknownLength
+    std::size_t getFixedLength(ast::Expression *expression) const
+    {
+        if(dynamic_cast<ast::Empty *>(expression) || dynamic_cast<ast::Cut *>(expression)
+           || dynamic_cast<ast::EOFTerminal *>(expression)
+           || dynamic_cast<ast::FollowedByPredicate *>(expression)
+           || dynamic_cast<ast::NotFollowedByPredicate *>(expression))
+            return 0;
+        if(auto terminal = dynamic_cast<ast::Terminal *>(expression))
+            return settings.utf8Input ? encodeUTF8(terminal->value).size() : 1;
+        if(auto literal = dynamic_cast<ast::Literal *>(expression))
         {
-            ss << "letter, $, or _";
+            if(!settings.utf8Input)
+                return literal->value.size();
+            std::size_t retval = 0;
+            for(char32_t ch : literal->value)
+                retval += encodeUTF8(ch).size();
+            return retval;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LetterDigitDollarOrUnderlineClassifier()))
+        if(dynamic_cast<ast::CharacterClass *>(expression) && !settings.utf8Input)
+            return 1;
+        return unknownLength;
+    }
+    // in a replayed rule, expressions that don't run code only record where they end, and
+    // only when that can't be worked out from the grammar when replaying
+    void writeParse(ast::Expression *expression)
+    {
+        if(!isRecordingActionTape || replayedExpressions.count(expression) != 0)
         {
-            ss << "letter, digit, $, or _";
+            expression->visit(*this);
+            return;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::DigitDollarOrUnderlineClassifier()))
+        isRecordingActionTape = false;
+        expression->visit(*this);
+        isRecordingActionTape = true;
+        if(getFixedLength(expression) == unknownLength)
         {
-            ss << "digit, $, or _";
+            sourceFile << R"(if(ruleResult__.success())
+    this->actionTape.push_back(ruleResult__.location);
+)";
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::SpaceOrTabClassifier()))
+    }
+    // sets location__ to the end of the match of expression starting at startLocation__
+    void writeReplay(ast::Expression *expression)
+    {
+        if(replayedExpressions.count(expression) != 0)
         {
-            ss << "space or tab";
+            expression->visit(*this);
+            return;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::SpaceTabOrLineEndingClassifier()))
+        std::size_t length = getFixedLength(expression);
+        if(length == unknownLength)
+            sourceFile << R"(location__ = this->actionTape[this->actionTapePosition++];
+)";
+        else if(length == 0)
+            sourceFile << R"(location__ = startLocation__;
+)";
+        else
+            sourceFile << R"(location__ = startLocation__ + )" << length << R"(;
+)";
+    }
+    std::string makeActionTapeMarkName()
+    {
+        std::ostringstream ss;
+        ss << "actionTapeMark" << actionTapeMarkCount++ << "__";
+        return ss.str();
+    }
+    // the tape holds how many times a repetition matched, counting a final empty match
+    std::string beginRepetitionActionTape()
+    {
+        if(!isRecordingActionTape)
+            return "";
+        auto name = makeActionTapeMarkName();
+        sourceFile << R"(std::size_t )" << name << R"( = this->actionTape.size();
+this->actionTape.push_back(0);
+)";
+        return name;
+    }
+    void writeRepetitionIteration(ast::Expression *expression,
+                                  const std::string &actionTapeMarkName)
+    {
+        if(actionTapeMarkName.empty())
         {
-            ss << "space, tab, or line ending";
+            writeParse(expression);
+            return;
         }
-        else if(characterClass->characterRanges.matchesClassifier(
-                    ast::CharacterClass::CharacterRanges::LineEndingClassifier()))
+        auto iterationName = makeActionTapeMarkName();
+        sourceFile << R"(std::size_t )" << iterationName << R"( = this->actionTape.size();
+)";
+        writeParse(expression);
+        sourceFile << R"(if(ruleResult__.fail())
+    this->actionTape.resize()" << iterationName << R"();
+else
+    this->actionTape[)" << actionTapeMarkName << R"(]++;
+)";
+    }
+    void writeRepetitionReplay(ast::Expression *expression)
+    {
+        sourceFile << R"({
+    auto savedStartLocation__ = startLocation__;
+    location__ = startLocation__;
+    for(std::size_t count__ = this->actionTape[this->actionTapePosition++]; count__ > 0; count__--)
+    {
+        startLocation__ = location__;
+@+@+)";
+        writeReplay(expression);
+        sourceFile << R"(@-@-    }
+    startLocation__ = savedStartLocation__;
+}
+)";
+    }
+    // rules called from a predicate record into the action tape, but aren't replayed
+    std::string beginPredicateActionTape(ast::Expression *predicate)
+    {
+        if(recordingPredicates.count(predicate) == 0)
+            return "";
+        auto name = makeActionTapeMarkName();
+        sourceFile << R"(std::size_t )" << name << R"( = this->actionTape.size();
+)";
+        return name;
+    }
+    void endPredicateActionTape(const std::string &actionTapeMarkName)
+    {
+        if(!actionTapeMarkName.empty())
         {
-            ss << "line ending";
+            sourceFile << R"(this->actionTape.resize()" << actionTapeMarkName << R"();
+)";
         }
-        else
+    }
+    std::string makeBacktrackPointName()
+    {
+        std::ostringstream ss;
+        ss << "backtrackPoint" << backtrackPointCount++ << "__";
+        return ss.str();
+    }
+    std::string beginBacktrackPoint()
+    {
+        auto name = makeBacktrackPointName();
+        sourceFile << R"({
+    Parser::BacktrackPoint )" << name << R"((*this, startLocation__);
+@+)";
+        return name;
+    }
+    void endBacktrackPoint()
+    {
+        sourceFile << R"(@-}
+)";
+    }
+    static std::vector<ast::Expression *> getAlternatives(ast::OrderedChoice *node)
+    {
+        std::vector<ast::Expression *> alternatives;
+        ast::Expression *expression = node;
+        while(auto orderedChoice = dynamic_cast<ast::OrderedChoice *>(expression))
         {
-            std::uint_fast32_t totalCharCount = 0;
-            const std::size_t firstCharsSize = 5;
-            char32_t firstChars[firstCharsSize];
-            std::size_t firstCharsUsed = 0;
-            for(const auto &range : characterClass->characterRanges.ranges)
-            {
-                assert(!range.empty());
-                totalCharCount += range.max - range.min + 1;
-                for(std::uint_fast32_t i = range.min; i <= range.max; i++)
-                {
-                    if(firstCharsUsed < firstCharsSize)
-                    {
-                        firstChars[firstCharsUsed++] = i;
-                    }
-                }
-            }
-            if(totalCharCount == 1)
-            {
-                assert(firstCharsUsed == 1);
-                ss << getCharName(firstChars[0]);
-            }
-            else if(totalCharCount == 2)
-            {
-                assert(firstCharsUsed == 2);
-                ss << getCharName(firstChars[0]) << " or " << getCharName(firstChars[1]);
-            }
-            else if(totalCharCount > 1 && totalCharCount <= firstCharsSize)
-            {
-                assert(firstCharsUsed == totalCharCount);
-                ss << getCharName(firstChars[0]);
-                for(std::size_t i = 1; i < totalCharCount; i++)
-                {
-                    ss << ", ";
-                    if(i + 1 == totalCharCount)
-                        ss << "or ";
-                    ss << getCharName(firstChars[i]);
-                }
+            alternatives.push_back(orderedChoice->second);
+            expression = orderedChoice->first;
+        }
+        alternatives.push_back(expression);
+        std::reverse(alternatives.begin(), alternatives.end());
+        return alternatives;
+    }
+    static std::string makeAlternativeMask(std::uint_fast64_t mask)
+    {
+        std::ostringstream ss;
+        ss << "0x" << std::hex << std::uppercase << mask << "ULL";
+        return ss.str();
+    }
+    // skipped alternatives record the failure they would have reported, so errors are the same
+    // as when every alternative is tried
+    std::string makeSkippedFailureStatement(const SkippedFailure &skippedFailure)
+    {
+        needsIsRequiredForSuccess = true;
+        std::ostringstream ss;
+        ss << "ruleResult__ = this->makeFail(startLocation__, startLocation__ + "
+           << skippedFailure.endOffset << ", \"" << escapeString(skippedFailure.message)
+           << "\", isRequiredForSuccess__);";
+        return ss.str();
+    }
+    std::string beginChoiceDispatch(const std::vector<ast::Expression *> &alternatives,
+                                    const std::vector<SkippedFailure> &skippedFailures)
+    {
+        constexpr std::size_t maximumAlternativeCount = 64;
+        const char32_t dispatchedCharacterCount = settings.utf8Input ? 0x80 : 0x100;
+        std::size_t alternativeCount = std::min(alternatives.size(), maximumAlternativeCount);
+        std::uint_fast64_t allMask = 0;
+        std::uint_fast64_t defaultMask = 0;
+        std::vector<std::uint_fast64_t> masks(dispatchedCharacterCount, 0);
+        for(std::size_t i = 0; i < alternativeCount; i++)
+        {
+            std::uint_fast64_t bit = static_cast<std::uint_fast64_t>(1) << i;
+            allMask |= bit;
+            if(!skippedFailures[i].canSkip)
+            {
+                defaultMask |= bit;
+                for(auto &mask : masks)
+                    mask |= bit;
+                continue;
             }
-            else
+            ast::FirstSet firstSet = alternatives[i]->getFirstSet();
+            if(firstSet.overlaps(dispatchedCharacterCount, ast::FirstSet::maxCharacter()))
+                defaultMask |= bit;
+            for(const auto &range : firstSet.ranges)
             {
-                ss << "[";
-                for(const auto &range : characterClass->characterRanges.ranges)
-                {
-                    if(range.min == range.max)
-                    {
-                        ss << escapeCharForCharacterClass(range.min);
-                    }
-                    else
-                    {
-                        ss << escapeCharForCharacterClass(range.min);
-                        ss << '-';
-                        ss << escapeCharForCharacterClass(range.max);
-                    }
-                }
-                ss << "]";
+                for(char32_t ch = range.min; ch <= range.max && ch < dispatchedCharacterCount; ch++)
+                    masks[ch] |= bit;
             }
         }
-        if(characterClass->inverted)
-            ss << " not allowed here";
-        return ss.str();
-    }
-    static std::string escapeString(const std::string &str)
+        // no alternative can match; try them all anyway so the errors are reported
+        if(defaultMask == 0)
+            defaultMask = allMask;
+        bool canSkipAlternatives = defaultMask != allMask;
+        for(auto &mask : masks)
+        {
+            if(mask == 0)
+                mask = allMask;
+            if(mask != allMask)
+                canSkipAlternatives = true;
+        }
+        if(!canSkipAlternatives)
+            return "";
+        std::ostringstream ss;
+        ss << "alternatives" << choiceDispatchCount++ << "__";
+        std::string name = ss.str();
+        sourceFile << R"({
+    std::uint_fast64_t )" << name << R"( = )" << makeAlternativeMask(allMask) << R"(;
+    if(startLocation__ < this->sourceSize)
     {
-        std::string retval;
-        retval.reserve(str.size() * 5 / 4);
-        for(unsigned char ch : str)
+)";
+        if(settings.utf8Input)
+            sourceFile << R"(        switch(static_cast<unsigned char>(this->source.get()[startLocation__]))
+)";
+        else
+            sourceFile << R"(        switch(this->source.get()[startLocation__])
+)";
+        sourceFile << R"(        {
+)";
+        std::vector<bool> written(dispatchedCharacterCount, false);
+        for(char32_t ch = 0; ch < dispatchedCharacterCount; ch++)
         {
-            retval += escapeChar(ch);
+            if(written[ch] || masks[ch] == defaultMask)
+                continue;
+            for(char32_t ch2 = ch; ch2 < dispatchedCharacterCount; ch2++)
+            {
+                if(masks[ch2] != masks[ch])
+                    continue;
+                written[ch2] = true;
+                sourceFile << R"(        case )" << (settings.utf8Input ? "'" : "U'")
+                           << escapeChar(ch2) << R"(':
+)";
+            }
+            sourceFile << R"(            )" << name << R"( = )" << makeAlternativeMask(masks[ch])
+                       << R"(;
+            break;
+)";
+        }
+        sourceFile << R"(        default:
+            )" << name << R"( = )" << makeAlternativeMask(defaultMask) << R"(;
+            break;
         }
-        return retval;
     }
-    static std::string translateName(const char *prefix, std::string name, const char *suffix)
-    {
-        assert(!name.empty());
-        name[0] = std::toupper(name[0]);
-        return prefix + std::move(name) + suffix;
+@+)";
+        return name;
     }
-    static std::string makeResultVariableName(std::string name)
+    void endChoiceDispatch()
     {
-        return translateName("result", std::move(name), "");
+        sourceFile << R"(@-}
+)";
     }
     static std::string makeParseFunctionName(std::string name)
     {
         return translateName("parse", std::move(name), "");
     }
+    std::size_t getResultsWindowChunkCount() const
+    {
+        return (settings.memoWindowSize + 0x1FF) / 0x100;
+    }
+    static std::string makeTryParseFunctionName(std::string name)
+    {
+        return translateName("tryParse", std::move(name), "");
+    }
+    static std::string makeTryParseResultType(const ast::Nonterminal *nonterminal)
+    {
+        if(nonterminal->type->isVoid)
+            return "ParseStatus";
+        return "ParseResult<" + nonterminal->type->code + ">";
+    }
     static std::string makeInternalParseFunctionName(std::string name)
     {
         return translateName("internalParse", std::move(name), "");
     }
+    static std::string makeReplayFunctionName(std::string name)
+    {
+        return translateName("replay", std::move(name), "");
+    }
     std::string getGuardMacroName() const
     {
         assert(!headerFileName.empty());
@@ -528,9 +1970,535 @@ struct CodeGenerator::CPlusPlus11 final : public CodeGenerator, public ast::Visi
         }
         os << ">\n";
     }
+    // declares the arena and allocator for values, ahead of the class code snippets and the
+    // members that can hold those values, so the arena is destroyed last
+    void writeValueArena()
+    {
+        headerFile << R"(
+public:
+    // a monotonic arena for the values built by the grammar's code; allocating only bumps a
+    // pointer, and nothing is freed until release
+    class ValueArena final
+    {
+        ValueArena(const ValueArena &) = delete;
+        ValueArena &operator=(const ValueArena &) = delete;
+
+    private:
+        struct Block final
+        {
+            Block *previous;
+        };
+        struct Destructor final
+        {
+            Destructor *next;
+            void (*destroy)(void *object);
+            void *object;
+        };
+        static constexpr std::size_t initialBlockSize = 0x1000;
+        static constexpr std::size_t maxBlockSize = 0x100000;
+        Block *lastBlock = nullptr;
+        Destructor *destructors = nullptr;
+        std::uintptr_t nextAddress = 0;
+        std::uintptr_t endAddress = 0;
+        std::size_t nextBlockSize = initialBlockSize;
+        std::size_t allocatedSize = 0;
+        static std::uintptr_t alignAddress(std::uintptr_t address, std::size_t alignment) noexcept
+        {
+            return (address + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+        }
+        void *allocateBlock(std::size_t size, std::size_t alignment);
+        static ValueArena *&getCurrentPointer() noexcept
+        {
+            static thread_local ValueArena *current = nullptr;
+            return current;
+        }
+        template <typename T>
+        static void destroy(void *object) noexcept
+        {
+            static_cast<T *>(object)->~T();
+        }
+
+    public:
+        ValueArena() = default;
+        ~ValueArena()
+        {
+            release();
+        }
+        // alignment must be a power of 2
+        void *allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+        {
+            std::uintptr_t address = alignAddress(nextAddress, alignment);
+            if(address >= endAddress || size >= endAddress - address)
+                return allocateBlock(size, alignment);
+            nextAddress = address + size;
+            return reinterpret_cast<void *>(address);
+        }
+        // objects that aren't trivially destructible are destroyed by release
+        template <typename T, typename... Args>
+        T *make(Args &&... args)
+        {
+            Destructor *destructor = nullptr;
+            if(!std::is_trivially_destructible<T>::value)
+            {
+                destructor =
+                    static_cast<Destructor *>(allocate(sizeof(Destructor), alignof(Destructor)));
+            }
+            T *retval = ::new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if(destructor)
+            {
+                destructor->next = destructors;
+                destructor->destroy = &destroy<T>;
+                destructor->object = retval;
+                destructors = destructor;
+            }
+            return retval;
+        }
+        // destroys the objects made by make and frees everything allocated
+        void release() noexcept;
+        // the bytes allocated from the heap for the arena's blocks
+        std::size_t getAllocatedSize() const noexcept
+        {
+            return allocatedSize;
+        }
+        // the arena used by default-constructed ValueAllocators on this thread; set while
+        // parsing
+        static ValueArena *getCurrent() noexcept
+        {
+            return getCurrentPointer();
+        }
+        class Scope final
+        {
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            ValueArena *previous;
+
+        public:
+            explicit Scope(ValueArena &arena) noexcept : previous(getCurrentPointer())
+            {
+                getCurrentPointer() = &arena;
+            }
+            ~Scope()
+            {
+                getCurrentPointer() = previous;
+            }
+        };
+    };
+    // allocates from the arena that was current when it was constructed, or from the heap
+    // when there was none; the arena goes along with moved and swapped containers, but copies
+    // use the arena that's current when they're made, so a value copied after parsing is on
+    // the heap and can outlive the parser
+    template <typename T>
+    class ValueAllocator
+    {
+        template <typename U>
+        friend class ValueAllocator;
+
+    private:
+        ValueArena *arena;
+
+    public:
+        typedef T value_type;
+        typedef std::false_type propagate_on_container_copy_assignment;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+        template <typename U>
+        struct rebind
+        {
+            typedef ValueAllocator<U> other;
+        };
+        ValueAllocator() noexcept : arena(ValueArena::getCurrent())
+        {
+        }
+        explicit ValueAllocator(ValueArena *arena) noexcept : arena(arena)
+        {
+        }
+        template <typename U>
+        ValueAllocator(const ValueAllocator<U> &other) noexcept : arena(other.arena)
+        {
+        }
+        ValueArena *getArena() const noexcept
+        {
+            return arena;
+        }
+        ValueAllocator select_on_container_copy_construction() const noexcept
+        {
+            return ValueAllocator();
+        }
+        T *allocate(std::size_t count)
+        {
+            if(count > std::numeric_limits<std::size_t>::max() / sizeof(T))
+                throw std::bad_alloc();
+            if(arena)
+                return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+            return static_cast<T *>(::operator new(count * sizeof(T)));
+        }
+        void deallocate(T *pointer, std::size_t) noexcept
+        {
+            if(!arena)
+                ::operator delete(pointer);
+        }
+        friend bool operator==(const ValueAllocator &a, const ValueAllocator &b) noexcept
+        {
+            return a.arena == b.arena;
+        }
+        friend bool operator!=(const ValueAllocator &a, const ValueAllocator &b) noexcept
+        {
+            return a.arena != b.arena;
+        }
+    };
+    typedef std::basic_string<char, std::char_traits<char>, ValueAllocator<char>> ValueString;
+    typedef std::basic_string<char32_t, std::char_traits<char32_t>, ValueAllocator<char32_t>>
+        ValueU32String;
+    template <typename T>
+    using ValueVector = std::vector<T, ValueAllocator<T>>;
+
+private:
+    ValueArena valueArena;
+)";
+    }
+    void writeValueArenaDefinitions()
+    {
+        sourceFile << R"(constexpr std::size_t Parser::ValueArena::initialBlockSize;
+constexpr std::size_t Parser::ValueArena::maxBlockSize;
+
+void *Parser::ValueArena::allocateBlock(std::size_t size, std::size_t alignment)
+{
+    constexpr std::size_t headerSize =
+        (sizeof(Block) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    // ::operator new only aligns to alignof(std::max_align_t)
+    std::size_t padding = alignment > alignof(std::max_align_t) ? alignment - 1 : 0;
+    if(size > std::numeric_limits<std::size_t>::max() - headerSize - padding)
+        throw std::bad_alloc();
+    std::size_t neededSize = headerSize + padding + size;
+    if(neededSize > nextBlockSize / 4)
+    {
+        // large allocations get their own block, linked behind the one being filled
+        Block *block = static_cast<Block *>(::operator new(neededSize));
+        allocatedSize += neededSize;
+        if(lastBlock)
+        {
+            block->previous = lastBlock->previous;
+            lastBlock->previous = block;
+        }
+        else
+        {
+            block->previous = nullptr;
+            lastBlock = block;
+        }
+        return reinterpret_cast<void *>(
+            alignAddress(reinterpret_cast<std::uintptr_t>(block) + headerSize, alignment));
+    }
+    Block *block = static_cast<Block *>(::operator new(nextBlockSize));
+    allocatedSize += nextBlockSize;
+    block->previous = lastBlock;
+    lastBlock = block;
+    std::uintptr_t address =
+        alignAddress(reinterpret_cast<std::uintptr_t>(block) + headerSize, alignment);
+    nextAddress = address + size;
+    endAddress = reinterpret_cast<std::uintptr_t>(block) + nextBlockSize;
+    if(nextBlockSize < maxBlockSize)
+        nextBlockSize *= 2;
+    return reinterpret_cast<void *>(address);
+}
+
+void Parser::ValueArena::release() noexcept
+{
+    for(Destructor *destructor = destructors; destructor; destructor = destructor->next)
+        destructor->destroy(destructor->object);
+    destructors = nullptr;
+    while(lastBlock)
+    {
+        Block *block = lastBlock;
+        lastBlock = block->previous;
+        ::operator delete(block);
+    }
+    nextAddress = 0;
+    endAddress = 0;
+    nextBlockSize = initialBlockSize;
+    allocatedSize = 0;
+}
+
+)";
+    }
+    // the template arguments of a call from inside the rule's own functions
+    static std::string makeTemplateArgumentNames(const ast::Nonterminal *nonterminal)
+    {
+        if(nonterminal->templateArguments.empty())
+            return "";
+        std::string retval = "<";
+        auto seperator = "";
+        for(auto templateArgument : nonterminal->templateArguments)
+        {
+            retval += seperator;
+            seperator = ", ";
+            retval += templateArgument->name;
+        }
+        return retval + ">";
+    }
+    // the template arguments passed by a call
+    static std::string makeTemplateArgumentValues(const ast::NonterminalExpression *node)
+    {
+        if(node->templateArguments.empty())
+            return "";
+        std::string retval = "<";
+        auto seperator = "";
+        for(auto templateArgument : node->templateArguments)
+        {
+            retval += seperator;
+            seperator = ", ";
+            retval += templateArgument->getCode();
+        }
+        return retval + ">";
+    }
+    // rules that aren't memoized and can't reach themselves without going through a memoized
+    // rule are expanded at their call sites when small enough or marked @inline
+    void findInlinedNonterminals(const ast::Grammar *grammar)
+    {
+        std::map<const ast::Nonterminal *, std::size_t> inlineSizes;
+        for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+        {
+            if(!nonterminal->settings.caching && !nonterminal->settings.hasCut)
+                inlineSizes[nonterminal] = InlineSizeVisitor::unknownSize;
+        }
+        // sizes of recursive rules stay unknown
+        for(bool done = false; !done;)
+        {
+            done = true;
+            for(auto &nonterminalAndSize : inlineSizes)
+            {
+                InlineSizeVisitor visitor(inlineSizes);
+                std::get<0>(nonterminalAndSize)->expression->visit(visitor);
+                if(std::get<1>(nonterminalAndSize) != visitor.size)
+                {
+                    std::get<1>(nonterminalAndSize) = visitor.size;
+                    done = false;
+                }
+            }
+        }
+        inlinedNonterminals.clear();
+        for(const auto &nonterminalAndSize : inlineSizes)
+        {
+            const ast::Nonterminal *nonterminal = std::get<0>(nonterminalAndSize);
+            std::size_t size = std::get<1>(nonterminalAndSize);
+            if(size == InlineSizeVisitor::unknownSize)
+                continue;
+            // profiled rules keep their own functions so they're counted separately
+            if(settings.ruleProfile)
+                continue;
+            if(nonterminal->settings.forceInline || size <= settings.inlineSizeLimit)
+                inlinedNonterminals.insert(nonterminal);
+        }
+        ruleNames.clear();
+        for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+        {
+            InlineSizeVisitor visitor(inlineSizes);
+            nonterminal->expression->visit(visitor);
+            RuleNames &names = ruleNames[nonterminal];
+            names.declaredNames = std::move(visitor.variableNames);
+            for(auto templateArgument : nonterminal->templateArguments)
+                names.declaredNames.insert(templateArgument->name);
+            names.codeIdentifiers = std::move(visitor.codeIdentifiers);
+        }
+    }
+    // rules with actions that parsing depends on, and every rule they call, run their actions
+    // while parsing; the other rules are replayed if they return a value or run code
+    void findDeferredNonterminals(const ast::Grammar *grammar)
+    {
+        deferredNonterminals.clear();
+        replayedNonterminals.clear();
+        replayedExpressions.clear();
+        recordingPredicates.clear();
+        if(!settings.deferActions)
+            return;
+        std::map<const ast::Nonterminal *, std::set<const ast::Nonterminal *>> calledNonterminals;
+        std::set<const ast::Nonterminal *> eagerNonterminals;
+        std::vector<const ast::Nonterminal *> worklist;
+        for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+        {
+            DeferredActionsVisitor visitor(replayedNonterminals);
+            nonterminal->expression->visit(visitor);
+            if(visitor.needsEagerActions && eagerNonterminals.insert(nonterminal).second)
+                worklist.push_back(nonterminal);
+            calledNonterminals[nonterminal] = std::move(visitor.calledNonterminals);
+        }
+        while(!worklist.empty())
+        {
+            const ast::Nonterminal *nonterminal = worklist.back();
+            worklist.pop_back();
+            for(const ast::Nonterminal *calledNonterminal : calledNonterminals[nonterminal])
+            {
+                if(eagerNonterminals.insert(calledNonterminal).second)
+                    worklist.push_back(calledNonterminal);
+            }
+        }
+        for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+        {
+            if(eagerNonterminals.count(nonterminal) != 0)
+                continue;
+            deferredNonterminals.insert(nonterminal);
+            if(!nonterminal->type->isVoid)
+                replayedNonterminals.insert(nonterminal);
+        }
+        for(bool done = false; !done;)
+        {
+            done = true;
+            for(const ast::Nonterminal *nonterminal : deferredNonterminals)
+            {
+                if(replayedNonterminals.count(nonterminal) != 0)
+                    continue;
+                DeferredActionsVisitor visitor(replayedNonterminals);
+                nonterminal->expression->visit(visitor);
+                if(visitor.isReplayed)
+                {
+                    replayedNonterminals.insert(nonterminal);
+                    done = false;
+                }
+            }
+        }
+        for(const ast::Nonterminal *nonterminal : deferredNonterminals)
+        {
+            DeferredActionsVisitor visitor(replayedNonterminals);
+            nonterminal->expression->visit(visitor);
+            replayedExpressions.insert(visitor.replayedExpressions.begin(),
+                                       visitor.replayedExpressions.end());
+            recordingPredicates.insert(visitor.recordingPredicates.begin(),
+                                       visitor.recordingPredicates.end());
+        }
+    }
+    bool isDeferred(const ast::Nonterminal *nonterminal) const
+    {
+        return deferredNonterminals.count(nonterminal) != 0;
+    }
+    bool isReplayed(const ast::Nonterminal *nonterminal) const
+    {
+        return replayedNonterminals.count(nonterminal) != 0;
+    }
+    // deferred rules don't have a value until they're replayed
+    bool memoizesValue(const ast::Nonterminal *nonterminal) const
+    {
+        return nonterminal->settings.memoizeValue && !isDeferred(nonterminal);
+    }
+    std::string getInternalParseReturnType(const ast::Nonterminal *nonterminal) const
+    {
+        if(isDeferred(nonterminal))
+            return "void";
+        return nonterminal->type->code;
+    }
+    // the argument is the variable the template argument is named after, so it needs no binding
+    static bool isTemplateArgumentPassedThrough(const ast::NonterminalExpression *node,
+                                                std::size_t index)
+    {
+        return node->templateArguments[index]->getCode()
+               == node->value->templateArguments[index]->name;
+    }
+    bool canInline(const ast::NonterminalExpression *node) const
+    {
+        const ast::Nonterminal *inlinedNonterminal = node->value;
+        if(inlinedNonterminals.count(inlinedNonterminal) == 0)
+            return false;
+        // replay functions mirror the parse functions call for call
+        if(isReplayed(inlinedNonterminal)
+           || isDeferred(inlinedNonterminal) != isDeferred(nonterminal))
+            return false;
+        // C++ doesn't allow redeclaring the enclosing function's template parameters
+        std::set<std::string> functionTemplateArgumentNames;
+        for(auto templateArgument : nonterminal->templateArguments)
+            functionTemplateArgumentNames.insert(templateArgument->name);
+        std::set<std::string> passedThroughNames;
+        for(std::size_t i = 0; i < node->templateArguments.size(); i++)
+        {
+            if(isTemplateArgumentPassedThrough(node, i))
+                passedThroughNames.insert(inlinedNonterminal->templateArguments[i]->name);
+        }
+        const RuleNames &names = ruleNames.at(inlinedNonterminal);
+        for(const std::string &name : names.declaredNames)
+        {
+            if(functionTemplateArgumentNames.count(name) != 0 && passedThroughNames.count(name) == 0)
+                return false;
+        }
+        // code can't be moved where a name it uses would refer to one of the caller's variables
+        for(const std::string &name : names.codeIdentifiers)
+        {
+            if(visibleNames.count(name) != 0 && names.declaredNames.count(name) == 0)
+                return false;
+        }
+        return true;
+    }
+    // runs the rule's code along the accepted parse recorded in the action tape
+    void writeReplayFunction(const ast::Nonterminal *nonterminal)
+    {
+        sourceFile << R"(
+)";
+        writeTemplateDeclaration(sourceFile, nonterminal->templateArguments);
+        sourceFile << R"(auto Parser::)" << makeReplayFunctionName(nonterminal->name)
+                   << R"((std::size_t startLocation__, std::size_t &locationOut__) -> )"
+                   << nonterminal->type->code << R"(
+{
+@+)";
+        if(!nonterminal->type->isVoid)
+        {
+            sourceFile << nonterminal->type->code << R"( returnValue__{};
+)";
+        }
+        state = State::DeclareLocals;
+        nonterminal->expression->visit(*this);
+        sourceFile << R"(std::size_t location__ = startLocation__;
+)";
+        state = State::ReplayFunction;
+        writeReplay(nonterminal->expression);
+        writeCharacterRuleReturnValue(nonterminal);
+        sourceFile << R"(locationOut__ = location__;
+)";
+        if(!nonterminal->type->isVoid)
+        {
+            sourceFile << R"(return returnValue__;
+)";
+        }
+        sourceFile << R"(@-}
+)";
+    }
     virtual void generateCode(const ast::Grammar *grammar) override
     {
         auto guardMacroName = getGuardMacroName();
+        auto sourceCharType = settings.utf8Input ? "char" : "char32_t";
+        hasCuts = false;
+        for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+        {
+            if(nonterminal->settings.hasCut)
+                hasCuts = true;
+        }
+        usesFindFirstOf = false;
+        for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+        {
+            RepetitionVisitor repetitionVisitor;
+            nonterminal->expression->visit(repetitionVisitor);
+            for(ast::Expression *expression : repetitionVisitor.repeatedExpressions)
+            {
+                if(!getScanStopCharacters(expression).empty() || !getScanLiteral(expression).empty())
+                    usesFindFirstOf = true;
+            }
+        }
+        memoWriteBack = hasCuts || settings.memoTable == CPlusPlus11Settings::MemoTable::Windowed
+                        || settings.compactMemo;
+        findInlinedNonterminals(grammar);
+        findDeferredNonterminals(grammar);
+        memoProfileIndexes.clear();
+        if(settings.memoProfile)
+        {
+            for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+            {
+                if(nonterminal->settings.caching)
+                    memoProfileIndexes.emplace(nonterminal, memoProfileIndexes.size());
+            }
+        }
+        ruleProfileIndexes.clear();
+        if(settings.ruleProfile)
+        {
+            for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+                ruleProfileIndexes.emplace(nonterminal, ruleProfileIndexes.size());
+        }
         sourceFile << R"(// automatically generated from )" << grammar->location.source->fileName
                    << R"(
 )";
@@ -545,8 +2513,21 @@ struct CodeGenerator::CPlusPlus11 final : public CodeGenerator, public ast::Visi
                 writeCode(headerFile, topLevelCodeSnippet->code, topLevelCodeSnippet->location);
             }
         }
-        sourceFile << R"(#include ")" << headerFileNameFromSourceFile << R"("
-
+        sourceFile << R"(#include ")" << headerFileNameFromSourceFile << R"("
+)";
+        if(usesFindFirstOf)
+        {
+            sourceFile << R"(#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+)";
+        }
+        if(settings.ruleProfileCycles)
+        {
+            sourceFile << R"(#include <chrono>
+)";
+        }
+        sourceFile << R"(
 )";
         headerFile << R"(#ifndef )" << guardMacroName << R"(
 #define )" << guardMacroName << R"(
@@ -558,9 +2539,18 @@ struct CodeGenerator::CPlusPlus11 final : public CodeGenerator, public ast::Visi
 #include <stdexcept>
 #include <sstream>
 #include <vector>
-#include <list>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <limits>
 )";
+        if(settings.valueArena)
+        {
+            headerFile << R"(#include <new>
+#include <type_traits>
+)";
+        }
         for(auto topLevelCodeSnippet : grammar->topLevelCodeSnippets)
         {
             if(topLevelCodeSnippet->kind == ast::TopLevelCodeSnippet::Kind::Header)
@@ -581,6 +2571,8 @@ struct CodeGenerator::CPlusPlus11 final : public CodeGenerator, public ast::Visi
     Parser(const Parser &) = delete;
     Parser &operator=(const Parser &) = delete;
 )";
+        if(settings.valueArena)
+            writeValueArena();
         for(auto topLevelCodeSnippet : grammar->topLevelCodeSnippets)
         {
             if(topLevelCodeSnippet->kind == ast::TopLevelCodeSnippet::Kind::Class)
@@ -619,30 +2611,100 @@ private:
             return !empty() && !isSuccess;
         }
     };
-    struct Results final
+)";
+        if(settings.compactMemo)
+        {
+            headerFile << R"(    // a RuleResult stored relative to the position it was memoized at
+    struct CompactRuleResult final
+    {
+        static constexpr std::uint32_t wide = 0xFFFFFFFFUL;
+        // 0 when empty, wide when stored in wideRuleResults, otherwise 1 + the offset of location
+        std::uint32_t location = 0;
+        // the offset of endLocation shifted left by 1 with isSuccess in the low bit,
+        // or the index into wideRuleResults
+        std::uint32_t endLocationAndSuccess = 0;
+    };
+)";
+        }
+        headerFile << R"(    struct Results final
     {
 @+@+)";
         for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
         {
             if(nonterminal->settings.caching)
             {
-                headerFile << "RuleResult " << makeResultVariableName(nonterminal->name);
+                std::string dimensions;
                 for(auto templateArgument : nonterminal->templateArguments)
                 {
-                    headerFile << "[" << templateArgument->type->values.size() << "]";
+                    dimensions += "[" + std::to_string(templateArgument->type->values.size()) + "]";
+                }
+                headerFile << (settings.compactMemo ? "CompactRuleResult " : "RuleResult ")
+                           << makeResultVariableName(nonterminal->name)
+                           << dimensions << ";\n";
+                if(memoizesValue(nonterminal))
+                {
+                    headerFile << nonterminal->type->code << " "
+                               << makeValueVariableName(nonterminal->name) << dimensions
+                               << "{};\n";
+                    headerFile << "bool " << makeHasValueVariableName(nonterminal->name)
+                               << dimensions << "{};\n";
                 }
-                headerFile << ";\n";
             }
         }
         headerFile << R"(@_@-};
-    struct ResultsChunk final
+)";
+        if(settings.memoTable != CPlusPlus11Settings::MemoTable::Windowed)
+        {
+            headerFile << R"(    struct ResultsChunk final
     {
         static constexpr std::size_t allocated = 0x100;
         Results values[allocated];
-        std::size_t used = 0;
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(        std::size_t maxPosition = 0;
+)";
+            }
+            headerFile << R"(    };
+    // index into resultsChunks' values; 0 is never allocated
+    typedef std::uint32_t ResultsIndex;
+)";
+        }
+        if(hasCuts)
+        {
+            headerFile << R"(    struct BacktrackPoint final
+    {
+        BacktrackPoint(const BacktrackPoint &) = delete;
+        BacktrackPoint &operator=(const BacktrackPoint &) = delete;
+        Parser &parser;
+        BacktrackPoint *const previous;
+        const std::size_t position;
+        bool active = true;
+        BacktrackPoint(Parser &parser, std::size_t position)
+            : parser(parser), previous(parser.backtrackPoints), position(position)
+        {
+            parser.backtrackPoints = this;
+        }
+        ~BacktrackPoint()
+        {
+            parser.backtrackPoints = previous;
+        }
+        bool isActive() const
+        {
+            return active;
+        }
+        void cut()
+        {
+            active = false;
+        }
     };
-
+)";
+        }
+        headerFile << R"(
 public:
+    struct BorrowedSource final
+    {
+    };
     struct ParseError : public std::runtime_error
     {
         std::size_t location;
@@ -658,34 +2720,527 @@ public:
         {
         }
     };
+    struct ParseStatus
+    {
+        // the end of the match on success, otherwise the error location
+        std::size_t location = 0;
+        // nullptr on success
+        const char *message = nullptr;
+        bool success() const noexcept
+        {
+            return message == nullptr;
+        }
+        explicit operator bool() const noexcept
+        {
+            return success();
+        }
+    };
+    template <typename T>
+    struct ParseResult final : public ParseStatus
+    {
+        T value{};
+    };
 
 private:
-    std::vector<Results *> resultsPointers;
-    std::list<ResultsChunk> resultsChunks;
-    Results eofResults;
-    const std::shared_ptr<const char32_t> source;
-    const std::size_t sourceSize;
+)";
+        if(settings.memoTable != CPlusPlus11Settings::MemoTable::Windowed)
+        {
+            headerFile << R"(    std::vector<std::unique_ptr<ResultsChunk>> resultsChunks;
+    std::vector<std::unique_ptr<ResultsChunk>> freeResultsChunks;
+    ResultsIndex resultsUsed = 1;
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(    // the number of released chunks whose slots were removed from the front of resultsChunks
+    std::size_t resultsChunksBase = 0;
+    std::size_t firstLiveResultsChunk = 0;
+)";
+            }
+        }
+        switch(settings.memoTable)
+        {
+        case CPlusPlus11Settings::MemoTable::Dense:
+            headerFile << R"(    std::vector<ResultsIndex> resultsIndexes;
+)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Hashed:
+            headerFile << R"(    struct ResultsTableEntry final
+    {
+        std::size_t position = std::string::npos;
+        ResultsIndex index = 0;
+    };
+    std::vector<ResultsTableEntry> resultsTable;
+    std::size_t resultsTableUsed = 0;
+    std::size_t resultsTableShift = 0;
+)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Windowed:
+            headerFile << R"(    struct ResultsWindowChunk final
+    {
+        static constexpr std::size_t allocated = 0x100;
+        std::size_t startPosition = std::string::npos;
+        Results values[allocated];
+    };
+    std::vector<ResultsWindowChunk> resultsWindow;
+)";
+            break;
+        }
+        if(!memoProfileIndexes.empty())
+        {
+            headerFile << R"(    std::size_t memoProfileHits[)" << memoProfileIndexes.size() << R"(]{};
+    std::size_t memoProfileMisses[)" << memoProfileIndexes.size() << R"(]{};
+)";
+        }
+        if(!ruleProfileIndexes.empty())
+        {
+            headerFile << R"(    struct RuleCounters final
+    {
+        std::uint_least64_t invocations = 0;
+        std::uint_least64_t memoHits = 0;
+        std::uint_least64_t memoMisses = 0;
+        std::uint_least64_t successes = 0;
+        std::uint_least64_t failures = 0;
+        std::uint_least64_t charactersConsumed = 0;
+        std::uint_least64_t cycles = 0;
+    };
+    // counts an invocation of a rule and, when the rule returns, its result
+    class RuleProfileScope final
+    {
+        RuleProfileScope(const RuleProfileScope &) = delete;
+        RuleProfileScope &operator=(const RuleProfileScope &) = delete;
+
+    private:
+        RuleCounters &counters;
+        const RuleResult &ruleResult;
+        std::size_t startLocation;
+)";
+            if(settings.ruleProfileCycles)
+            {
+                headerFile << R"(        std::uint_least64_t startCycles;
+)";
+            }
+            headerFile << R"(
+    public:
+        RuleProfileScope(RuleCounters &counters, const RuleResult &ruleResult, std::size_t startLocation)
+            : counters(counters),
+            ``ruleResult(ruleResult),
+            ``startLocation(startLocation))";
+            if(settings.ruleProfileCycles)
+            {
+                headerFile << R"(,
+            ``startCycles(readCycleCounter()))";
+            }
+            headerFile << R"(
+        {
+            counters.invocations++;
+        }
+        ~RuleProfileScope()
+        {
+)";
+            if(settings.ruleProfileCycles)
+            {
+                headerFile << R"(            counters.cycles += readCycleCounter() - startCycles;
+)";
+            }
+            headerFile << R"(            if(ruleResult.success())
+            {
+                counters.successes++;
+                counters.charactersConsumed += ruleResult.location - startLocation;
+            }
+            else
+            {
+                counters.failures++;
+            }
+        }
+    };
+    RuleCounters ruleCounters[)" << ruleProfileIndexes.size() << R"(];
+)";
+            if(settings.ruleProfileCycles)
+            {
+                headerFile << R"(    static std::uint_least64_t readCycleCounter() noexcept;
+)";
+            }
+        }
+        headerFile << R"(    Results eofResults;
+)";
+        if(!replayedNonterminals.empty())
+        {
+            headerFile << R"(    // recorded while parsing for replaying the accepted parse: the alternative each
+    // choice took, the match count of each repetition, whether each optional expression
+    // matched and where expressions without code end
+    std::vector<std::size_t> actionTape;
+    std::size_t actionTapePosition = 0;
+)";
+        }
+        if(settings.compactMemo)
+        {
+            headerFile << R"(    std::vector<RuleResult> wideRuleResults;
+)";
+        }
+        headerFile << R"(
+    std::shared_ptr<const )" << sourceCharType << R"(> source;
+    std::size_t sourceSize;
     std::size_t errorLocation = 0;
     std::size_t errorInputEndLocation = 0;
     const char *errorMessage = "no error";
-
+)";
+        if(hasCuts)
+        {
+            headerFile << R"(    BacktrackPoint *backtrackPoints = nullptr;
+    std::size_t releasedPosition = 0;
+)";
+        }
+        headerFile << R"(
 private:
-    Results &getResults(std::size_t position)
+)";
+        auto releasedCheck = hasCuts ? R"(
+        if(position < releasedPosition)
+            return nullptr;)" :
+                                       "";
+        if(settings.memoTable != CPlusPlus11Settings::MemoTable::Windowed)
+        {
+            auto chunkIndex =
+                hasCuts ? "index / ResultsChunk::allocated - resultsChunksBase" :
+                          "index / ResultsChunk::allocated";
+            headerFile << R"(    Results &getResultsAt(std::size_t index)
+    {
+        return resultsChunks[)" << chunkIndex << R"(]->values[index % ResultsChunk::allocated];
+    }
+    ResultsIndex allocateResults()" << (hasCuts ? "std::size_t position" : "") << R"()
+    {
+        if(resultsUsed == std::numeric_limits<ResultsIndex>::max())
+            throw std::length_error("too many memoized positions");
+        ResultsIndex index = resultsUsed++;
+        if()" << chunkIndex << R"( >= resultsChunks.size())
+        {
+            if(freeResultsChunks.empty())
+            {
+                resultsChunks.emplace_back(new ResultsChunk);
+            }
+            else
+            {
+                resultsChunks.push_back(std::move(freeResultsChunks.back()));
+                freeResultsChunks.pop_back();
+            }
+        }
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(        ResultsChunk &chunk = *resultsChunks[)" << chunkIndex << R"(];
+        if(chunk.maxPosition < position)
+            chunk.maxPosition = position;
+)";
+            }
+            headerFile << R"(        return index;
+    }
+    // chunks in freeResultsChunks are always cleared
+    void clearResults()
+    {
+        for(std::size_t index = )"
+                       << (hasCuts ? "std::max<std::size_t>(1, (resultsChunksBase + "
+                                     "firstLiveResultsChunk) * ResultsChunk::allocated)" :
+                                     "1")
+                       << R"(; index < resultsUsed; index++)
+            getResultsAt(index) = Results();
+        for(std::unique_ptr<ResultsChunk> &chunk : resultsChunks)
+        {
+            if(!chunk)
+                continue;
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(            chunk->maxPosition = 0;
+)";
+            }
+            headerFile << R"(            freeResultsChunks.push_back(std::move(chunk));
+        }
+        resultsChunks.clear();
+        resultsUsed = 1;
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(        resultsChunksBase = 0;
+        firstLiveResultsChunk = 0;
+)";
+            }
+            headerFile << R"(    }
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(    void releaseResults(std::size_t position)
+    {
+        releasedPosition = position;
+        // the last chunk is still being filled
+        while(firstLiveResultsChunk + 1 < resultsChunks.size()
+        ``````&& resultsChunks[firstLiveResultsChunk]->maxPosition < position)
+        {
+            std::unique_ptr<ResultsChunk> &chunk = resultsChunks[firstLiveResultsChunk++];
+            for(Results &results : chunk->values)
+                results = Results();
+            chunk->maxPosition = 0;
+            freeResultsChunks.push_back(std::move(chunk));
+        }
+        // remove the released chunks' slots once they're at least half of resultsChunks, so it
+        // only holds about twice the live chunks
+        if(firstLiveResultsChunk != 0 && firstLiveResultsChunk * 2 >= resultsChunks.size())
+        {
+            resultsChunks.erase(resultsChunks.begin(), resultsChunks.begin() + firstLiveResultsChunk);
+            resultsChunksBase += firstLiveResultsChunk;
+            firstLiveResultsChunk = 0;
+        }
+    }
+)";
+            }
+        }
+        auto allocateResultsArguments = hasCuts ? "position" : "";
+        switch(settings.memoTable)
+        {
+        case CPlusPlus11Settings::MemoTable::Dense:
+            if(memoWriteBack)
+            {
+                headerFile << R"(    const Results *findResults(std::size_t position)
+    {
+        if(position >= sourceSize)
+            return &eofResults;)" << releasedCheck << R"(
+        ResultsIndex index = resultsIndexes[position];
+        if(index == 0)
+            return nullptr;
+        return &getResultsAt(index);
+    }
+    Results *getResults(std::size_t position)
+    {
+        if(position >= sourceSize)
+            return &eofResults;)" << releasedCheck << R"(
+        ResultsIndex &index = resultsIndexes[position];
+        if(index == 0)
+            index = allocateResults()" << allocateResultsArguments << R"();
+        return &getResultsAt(index);
+    }
+)";
+            }
+            else
+            {
+                headerFile << R"(    Results &getResults(std::size_t position)
+    {
+        if(position >= sourceSize)
+            return eofResults;
+        ResultsIndex &index = resultsIndexes[position];
+        if(index == 0)
+            index = allocateResults();
+        return getResultsAt(index);
+    }
+)";
+            }
+            break;
+        case CPlusPlus11Settings::MemoTable::Hashed:
+            headerFile << R"(    std::size_t getResultsTableIndex(std::size_t position) const
+    {
+        constexpr std::size_t multiplier = static_cast<std::size_t>(0x9E3779B97F4A7C15ULL);
+        return (position * multiplier) >> resultsTableShift;
+    }
+    void growResultsTable()
+    {
+        std::vector<ResultsTableEntry> oldResultsTable;
+        oldResultsTable.swap(resultsTable);
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(        resultsTableUsed = 0;
+        for(const ResultsTableEntry &entry : oldResultsTable)
+        {
+            if(entry.position != std::string::npos && entry.position >= releasedPosition)
+                resultsTableUsed++;
+        }
+        std::size_t size = 0x40;
+        while(resultsTableUsed * 4 >= size)
+            size *= 2;
+        resultsTable.resize(size);
+)";
+            }
+            else
+            {
+                headerFile << R"(        resultsTable.resize(oldResultsTable.empty() ? 0x40 : oldResultsTable.size() * 2);
+)";
+            }
+            headerFile << R"(        resultsTableShift = std::numeric_limits<std::size_t>::digits;
+        for(std::size_t size = resultsTable.size(); size > 1; size >>= 1)
+            resultsTableShift--;
+        std::size_t mask = resultsTable.size() - 1;
+        for(const ResultsTableEntry &entry : oldResultsTable)
+        {
+            if(entry.position == std::string::npos)
+                continue;
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(            if(entry.position < releasedPosition)
+                continue;
+)";
+            }
+            headerFile << R"(            std::size_t index = getResultsTableIndex(entry.position);
+            while(resultsTable[index].position != std::string::npos)
+                index = (index + 1) & mask;
+            resultsTable[index] = entry;
+        }
+    }
+)";
+            if(memoWriteBack)
+            {
+                headerFile << R"(    const Results *findResults(std::size_t position)
+    {
+        if(position >= sourceSize)
+            return &eofResults;)" << releasedCheck << R"(
+        if(resultsTable.empty())
+            return nullptr;
+        std::size_t mask = resultsTable.size() - 1;
+        std::size_t index = getResultsTableIndex(position);
+        while(true)
+        {
+            const ResultsTableEntry &entry = resultsTable[index];
+            if(entry.position == position)
+                return &getResultsAt(entry.index);
+            if(entry.position == std::string::npos)
+                return nullptr;
+            index = (index + 1) & mask;
+        }
+    }
+    Results *getResults(std::size_t position)
+    {
+        if(position >= sourceSize)
+            return &eofResults;)" << releasedCheck << R"(
+)";
+            }
+            else
+            {
+                headerFile << R"(    Results &getResults(std::size_t position)
+    {
+        if(position >= sourceSize)
+            return eofResults;
+)";
+            }
+            headerFile << R"(        if(resultsTableUsed * 2 >= resultsTable.size())
+            growResultsTable();
+        std::size_t mask = resultsTable.size() - 1;
+        std::size_t index = getResultsTableIndex(position);
+        while(true)
+        {
+            ResultsTableEntry &entry = resultsTable[index];
+            if(entry.position == position)
+                return )" << (memoWriteBack ? "&" : "") << R"(getResultsAt(entry.index);
+            if(entry.position == std::string::npos)
+            {
+                entry.position = position;
+                entry.index = allocateResults()" << allocateResultsArguments << R"();
+                resultsTableUsed++;
+                return )" << (memoWriteBack ? "&" : "") << R"(getResultsAt(entry.index);
+            }
+            index = (index + 1) & mask;
+        }
+    }
+)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Windowed:
+            headerFile << R"(    ResultsWindowChunk &getResultsWindowChunk(std::size_t position)
+    {
+        return resultsWindow[position / ResultsWindowChunk::allocated % resultsWindow.size()];
+    }
+    const Results *findResults(std::size_t position)
+    {
+        if(position >= sourceSize)
+            return &eofResults;)" << releasedCheck << R"(
+        ResultsWindowChunk &chunk = getResultsWindowChunk(position);
+        std::size_t offset = position % ResultsWindowChunk::allocated;
+        if(chunk.startPosition != position - offset)
+            return nullptr;
+        return &chunk.values[offset];
+    }
+    Results *getResults(std::size_t position)
+    {
+        if(position >= sourceSize)
+            return &eofResults;)" << releasedCheck << R"(
+        ResultsWindowChunk &chunk = getResultsWindowChunk(position);
+        std::size_t offset = position % ResultsWindowChunk::allocated;
+        if(chunk.startPosition != position - offset)
+        {
+            if(chunk.startPosition != std::string::npos && chunk.startPosition > position)
+                return nullptr;
+            chunk.startPosition = position - offset;
+            for(Results &results : chunk.values)
+                results = Results();
+        }
+        return &chunk.values[offset];
+    }
+)";
+            if(hasCuts)
+            {
+                headerFile << R"(    void releaseResults(std::size_t position)
+    {
+        releasedPosition = position;
+    }
+)";
+            }
+            break;
+        }
+        if(settings.compactMemo)
+        {
+            headerFile << R"(    RuleResult loadRuleResult(const CompactRuleResult &compact, std::size_t position) const
+    {
+        if(compact.location == CompactRuleResult::wide)
+            return wideRuleResults[compact.endLocationAndSuccess];
+        if(compact.location == 0)
+            return RuleResult();
+        return RuleResult(position + compact.location - 1,
+        ``````````````````position + (compact.endLocationAndSuccess >> 1),
+        ``````````````````compact.endLocationAndSuccess & 1);
+    }
+    void storeRuleResult(CompactRuleResult &compact, const RuleResult &ruleResult, std::size_t position)
+    {
+        if(ruleResult.empty())
+        {
+            compact = CompactRuleResult();
+            return;
+        }
+        if(ruleResult.location >= position && ruleResult.endLocation >= position
+        ```&& ruleResult.location - position < CompactRuleResult::wide - 1
+        ```&& ruleResult.endLocation - position <= (CompactRuleResult::wide >> 1))
+        {
+            if(compact.location == CompactRuleResult::wide)
+                wideRuleResults[compact.endLocationAndSuccess] = RuleResult();
+            compact.location = static_cast<std::uint32_t>(ruleResult.location - position + 1);
+            compact.endLocationAndSuccess = static_cast<std::uint32_t>(
+                (ruleResult.endLocation - position) << 1 | (ruleResult.isSuccess ? 1 : 0));
+            return;
+        }
+        // offsets don't fit in 32 bits; fall back to storing the full result
+        if(compact.location == CompactRuleResult::wide)
+        {
+            wideRuleResults[compact.endLocationAndSuccess] = ruleResult;
+            return;
+        }
+        if(wideRuleResults.size() >= CompactRuleResult::wide)
+            throw std::length_error("too many memoized results");
+        compact.location = CompactRuleResult::wide;
+        compact.endLocationAndSuccess = static_cast<std::uint32_t>(wideRuleResults.size());
+        wideRuleResults.push_back(ruleResult);
+    }
+)";
+        }
+        if(hasCuts)
+        {
+            headerFile << R"(    void commitCut(std::size_t position)
     {
-        if(position >= sourceSize)
-            return eofResults;
-        Results *&resultsPointer = resultsPointers[position];
-        if(!resultsPointer)
+        for(const BacktrackPoint *backtrackPoint = backtrackPoints; backtrackPoint;
+        ````backtrackPoint = backtrackPoint->previous)
         {
-            if(resultsChunks.empty() || resultsChunks.back().used >= ResultsChunk::allocated)
-            {
-                resultsChunks.emplace_back();
-            }
-            resultsPointer = &resultsChunks.back().values[resultsChunks.back().used++];
+            if(backtrackPoint->isActive() && backtrackPoint->position < position)
+                position = backtrackPoint->position;
         }
-        return *resultsPointer;
+        if(position > releasedPosition)
+            releaseResults(position);
     }
-    RuleResult makeFail(std::size_t location,
+)";
+        }
+        headerFile << R"(    RuleResult makeFail(std::size_t location,
     ````````````````````std::size_t inputEndLocation,
     ````````````````````const char *message,
     ````````````````````bool isRequiredForSuccess)
@@ -714,7 +3269,128 @@ private:
         assert(inputEndLocation != std::string::npos);
         return RuleResult(inputEndLocation, inputEndLocation, true);
     }
-    static std::pair<std::shared_ptr<const char32_t>, std::size_t> makeSource(
+    static bool isCharacterInRanges(const char32_t *ranges, std::size_t rangeCount, char32_t character)
+    {
+        std::size_t low = 0, high = rangeCount;
+        while(low < high)
+        {
+            std::size_t middle = low + (high - low) / 2;
+            if(character < ranges[2 * middle])
+                high = middle;
+            else if(character > ranges[2 * middle + 1])
+                low = middle + 1;
+            else
+                return true;
+        }
+        return false;
+    }
+    static char32_t decodeUTF8(const char *source, std::size_t sourceSize, std::size_t &position)
+    {
+        const char32_t replacementChar = U'\uFFFD';
+        unsigned long byte1 = static_cast<unsigned char>(source[position++]);
+        if(byte1 < 0x80)
+            return static_cast<char32_t>(byte1);
+        if(position >= sourceSize || byte1 < 0xC0 || (source[position] & 0xC0) != 0x80)
+            return replacementChar;
+        bool invalid = byte1 < 0xC2 || byte1 > 0xF4;
+        unsigned long byte2 = static_cast<unsigned char>(source[position++]);
+        if(byte1 < 0xE0)
+        {
+            if(invalid)
+                return replacementChar;
+            return static_cast<char32_t>(((byte1 & 0x1F) << 6) | (byte2 & 0x3F));
+        }
+        if(position >= sourceSize || (source[position] & 0xC0) != 0x80)
+            return replacementChar;
+        unsigned long byte3 = static_cast<unsigned char>(source[position++]);
+        if(byte1 < 0xF0)
+        {
+            if(byte1 == 0xE0 && byte2 < 0xA0)
+                invalid = true;
+            if(invalid)
+                return replacementChar;
+            return static_cast<char32_t>(((byte1 & 0xF) << 12) | ((byte2 & 0x3F) << 6)
+            ````````````````````````````| (byte3 & 0x3F));
+        }
+        if(position >= sourceSize || (source[position] & 0xC0) != 0x80)
+            return replacementChar;
+        unsigned long byte4 = static_cast<unsigned char>(source[position++]);
+        if(byte1 == 0xF0 && byte2 < 0x90)
+            invalid = true;
+        if(byte1 == 0xF4 && byte2 > 0x8F)
+            invalid = true;
+        if(invalid)
+            return replacementChar;
+        return static_cast<char32_t>(((byte1 & 0x7) << 18) | ((byte2 & 0x3F) << 12)
+        ````````````````````````````| ((byte3 & 0x3F) << 6) | (byte4 & 0x3F));
+    }
+)";
+        if(usesFindFirstOf)
+        {
+            headerFile << R"(    // returns the location of the first of characters at or after position, or sourceSize if
+    // there is none; at most 4 characters
+    std::size_t findFirstOf(std::size_t position,
+    ````````````````````````const )" << sourceCharType << R"( *characters,
+    ````````````````````````std::size_t characterCount) const;
+)";
+        }
+        if(settings.utf8Input)
+        {
+            headerFile << R"(    static std::pair<std::shared_ptr<const char>, std::size_t> makeSource(std::string source);
+    static std::pair<std::shared_ptr<const char>, std::size_t> makeSource(
+        const char32_t *source, std::size_t sourceSize);
+
+public:
+    Parser(std::pair<std::shared_ptr<const char>, std::size_t> source)
+        : Parser(std::move(std::get<0>(source)), std::get<1>(source))
+    {
+    }
+    Parser(std::shared_ptr<const char> source, std::size_t sourceSize);
+    Parser(std::string source);
+    Parser(const char *source, std::size_t sourceSize);
+    Parser(const char32_t *source, std::size_t sourceSize);
+    Parser(const std::u32string &source) : Parser(source.data(), source.size())
+    {
+    }
+    // source is used in place and must outlive the parser
+    Parser(BorrowedSource, const char *source, std::size_t sourceSize)
+        : Parser(std::shared_ptr<const char>(std::shared_ptr<const char>(), source), sourceSize)
+    {
+    }
+    // switches to a new source, keeping the memo table's allocated storage)" << (settings.valueArena ? R"(; releases the
+    // value arena, so values returned by earlier parses that still use it must be copied
+    // first)" : "") << R"(
+    void reset(std::shared_ptr<const char> source, std::size_t sourceSize);
+    void reset(std::pair<std::shared_ptr<const char>, std::size_t> source)
+    {
+        reset(std::move(std::get<0>(source)), std::get<1>(source));
+    }
+    void reset(std::string source)
+    {
+        reset(makeSource(std::move(source)));
+    }
+    void reset(const char *source, std::size_t sourceSize)
+    {
+        reset(makeSource(std::string(source, sourceSize)));
+    }
+    void reset(const char32_t *source, std::size_t sourceSize)
+    {
+        reset(makeSource(source, sourceSize));
+    }
+    void reset(const std::u32string &source)
+    {
+        reset(source.data(), source.size());
+    }
+    // source is used in place and must outlive the parser or the next reset
+    void reset(BorrowedSource, const char *source, std::size_t sourceSize)
+    {
+        reset(std::shared_ptr<const char>(std::shared_ptr<const char>(), source), sourceSize);
+    }
+)";
+        }
+        else
+        {
+            headerFile << R"(    static std::pair<std::shared_ptr<const char32_t>, std::size_t> makeSource(
         std::u32string source);
     static std::pair<std::shared_ptr<const char32_t>, std::size_t> makeSource(
         const char *source, std::size_t sourceSize);
@@ -731,14 +3407,100 @@ public:
     Parser(const std::string &source) : Parser(source.data(), source.size())
     {
     }
-
+    // source is used in place and must outlive the parser
+    Parser(BorrowedSource, const char32_t *source, std::size_t sourceSize)
+        : Parser(std::shared_ptr<const char32_t>(std::shared_ptr<const char32_t>(), source), sourceSize)
+    {
+    }
+    // switches to a new source, keeping the memo table's allocated storage)" << (settings.valueArena ? R"(; releases the
+    // value arena, so values returned by earlier parses that still use it must be copied
+    // first)" : "") << R"(
+    void reset(std::shared_ptr<const char32_t> source, std::size_t sourceSize);
+    void reset(std::pair<std::shared_ptr<const char32_t>, std::size_t> source)
+    {
+        reset(std::move(std::get<0>(source)), std::get<1>(source));
+    }
+    void reset(std::u32string source)
+    {
+        reset(makeSource(std::move(source)));
+    }
+    void reset(const char *source, std::size_t sourceSize)
+    {
+        reset(makeSource(source, sourceSize));
+    }
+    void reset(const char32_t *source, std::size_t sourceSize)
+    {
+        reset(makeSource(std::u32string(source, sourceSize)));
+    }
+    void reset(const std::string &source)
+    {
+        reset(source.data(), source.size());
+    }
+    // source is used in place and must outlive the parser or the next reset
+    void reset(BorrowedSource, const char32_t *source, std::size_t sourceSize)
+    {
+        reset(std::shared_ptr<const char32_t>(std::shared_ptr<const char32_t>(), source), sourceSize);
+    }
+)";
+        }
+        headerFile << R"(    // the bytes allocated for memoized results, including storage kept for reuse by reset
+    std::size_t getMemoTableSize() const noexcept;
+)";
+        if(settings.valueArena)
+        {
+            headerFile << R"(    // the arena the grammar's code allocates values from while parsing; reset and destroying
+    // the parser release it, so values using it must not outlive either
+    ValueArena &getValueArena() noexcept
+    {
+        return valueArena;
+    }
+)";
+        }
+        if(settings.memoProfile)
+        {
+            headerFile << R"(    // writes a line of "<rule> <hits> <misses>" for each memoized rule, counted over
+    // everything parsed so far; read by peg_parser_generator --memo-profile-use
+    void writeMemoProfile(std::ostream &os) const;
+)";
+        }
+        if(settings.ruleProfile)
+        {
+            headerFile << R"(    struct RuleProfile final
+    {
+        const char *rule;
+        std::uint_least64_t invocations;
+        std::uint_least64_t memoHits;
+        std::uint_least64_t memoMisses;
+        std::uint_least64_t successes;
+        std::uint_least64_t failures;
+        // in bytes for UTF-8 parsers
+        std::uint_least64_t charactersConsumed;
+        // including the rules it calls; 0 unless generated with --profile-cycles
+        std::uint_least64_t cycles;
+    };
+    // the counters of each rule, counted over everything parsed so far
+    std::vector<RuleProfile> profile() const;
+    void writeProfileJSON(std::ostream &os) const;
+    void writeProfileCSV(std::ostream &os) const;
+)";
+        }
+        headerFile << R"(
 public:
 @+)";
+        if(settings.valueArena)
+        {
+            headerFile << R"(// the returned values can use the value arena, which reset and destroying the parser
+// release; copy them to keep them longer
+)";
+        }
         for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
         {
             writeTemplateDeclaration(headerFile, nonterminal->templateArguments);
             headerFile << nonterminal->type->code << " " << makeParseFunctionName(nonterminal->name)
                        << "();\n";
+            writeTemplateDeclaration(headerFile, nonterminal->templateArguments);
+            headerFile << makeTryParseResultType(nonterminal) << " "
+                       << makeTryParseFunctionName(nonterminal->name) << "();\n";
         }
         headerFile << R"(@-
 private:
@@ -756,185 +3518,582 @@ private:
 {
 )";
         }
-        sourceFile
-            << R"(Parser::Parser(std::shared_ptr<const char32_t> source, std::size_t sourceSize)
-    : resultsPointers(sourceSize, nullptr),
-    ``resultsChunks(),
-    ``eofResults(),
-    ``source(std::move(source)),
+        if(usesFindFirstOf)
+            writeFindFirstOf();
+        sourceFile << R"(Parser::Parser(std::shared_ptr<const )" << sourceCharType
+                   << R"(> source, std::size_t sourceSize)
+    : )";
+        switch(settings.memoTable)
+        {
+        case CPlusPlus11Settings::MemoTable::Dense:
+            sourceFile << R"(resultsChunks(),
+    ``freeResultsChunks(),
+    ``resultsIndexes(sourceSize, 0),
+    ``)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Hashed:
+            sourceFile << R"(resultsChunks(),
+    ``freeResultsChunks(),
+    ``resultsTable(),
+    ``)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Windowed:
+            sourceFile << R"(resultsWindow(std::min<std::size_t>()"
+                       << getResultsWindowChunkCount()
+                       << R"(, sourceSize / ResultsWindowChunk::allocated + 1)),
+    ``)";
+            break;
+        }
+        sourceFile << R"(eofResults(),
+    ``)";
+        if(settings.compactMemo)
+        {
+            sourceFile << R"(wideRuleResults(),
+    ``)";
+        }
+        sourceFile << R"(source(std::move(source)),
     ``sourceSize(sourceSize)
 {
 }
 
-Parser::Parser(std::u32string source) : Parser(makeSource(std::move(source)))
+void Parser::reset(std::shared_ptr<const )" << sourceCharType
+                   << R"(> source, std::size_t sourceSize)
+{
+    this->source = std::move(source);
+    this->sourceSize = sourceSize;
+)";
+        switch(settings.memoTable)
+        {
+        case CPlusPlus11Settings::MemoTable::Dense:
+            sourceFile << R"(    resultsIndexes.assign(sourceSize, 0);
+    clearResults();
+)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Hashed:
+            // clearing the table would cost its whole capacity, which can be far more than the
+            // new source needs; the first lookup grows a new table from the minimum size
+            sourceFile << R"(    std::vector<ResultsTableEntry>().swap(resultsTable);
+    resultsTableUsed = 0;
+    clearResults();
+)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Windowed:
+            sourceFile << R"(    std::size_t windowChunkCount = std::min<std::size_t>()"
+                       << getResultsWindowChunkCount()
+                       << R"(, sourceSize / ResultsWindowChunk::allocated + 1);
+    if(resultsWindow.size() < windowChunkCount)
+        resultsWindow.resize(windowChunkCount);
+    for(ResultsWindowChunk &chunk : resultsWindow)
+    {
+        chunk.startPosition = std::string::npos;
+)";
+            if(settings.valueArena)
+            {
+                // stale values can't be left pointing into the released arena
+                sourceFile << R"(        for(Results &results : chunk.values)
+            results = Results();
+)";
+            }
+            sourceFile << R"(    }
+)";
+            break;
+        }
+        sourceFile << R"(    eofResults = Results();
+)";
+        if(settings.compactMemo)
+        {
+            sourceFile << R"(    wideRuleResults.clear();
+)";
+        }
+        if(settings.valueArena)
+        {
+            sourceFile << R"(    valueArena.release();
+)";
+        }
+        sourceFile << R"(    errorLocation = 0;
+    errorInputEndLocation = 0;
+    errorMessage = "no error";
+)";
+        if(hasCuts)
+        {
+            sourceFile << R"(    releasedPosition = 0;
+)";
+        }
+        sourceFile << R"(}
+
+std::size_t Parser::getMemoTableSize() const noexcept
+{
+    std::size_t retval = sizeof(eofResults);
+)";
+        switch(settings.memoTable)
+        {
+        case CPlusPlus11Settings::MemoTable::Dense:
+            sourceFile << R"(    retval += resultsIndexes.capacity() * sizeof(ResultsIndex);
+)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Hashed:
+            sourceFile << R"(    retval += resultsTable.capacity() * sizeof(ResultsTableEntry);
+)";
+            break;
+        case CPlusPlus11Settings::MemoTable::Windowed:
+            sourceFile << R"(    retval += resultsWindow.capacity() * sizeof(ResultsWindowChunk);
+)";
+            break;
+        }
+        if(settings.memoTable != CPlusPlus11Settings::MemoTable::Windowed)
+        {
+            // the slots before firstLiveResultsChunk hold released chunks
+            sourceFile << R"(    retval += (resultsChunks.size())"
+                       << (hasCuts ? " - firstLiveResultsChunk" : "")
+                       << R"( + freeResultsChunks.size()) * sizeof(ResultsChunk);
+)";
+        }
+        if(settings.compactMemo)
+        {
+            sourceFile << R"(    retval += wideRuleResults.capacity() * sizeof(RuleResult);
+)";
+        }
+        sourceFile << R"(    return retval;
+}
+
+)";
+        if(settings.valueArena)
+            writeValueArenaDefinitions();
+        if(settings.memoProfile)
+        {
+            sourceFile << R"(void Parser::writeMemoProfile(std::ostream &os) const
+{
+@+)";
+            for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+            {
+                auto iter = memoProfileIndexes.find(nonterminal);
+                if(iter == memoProfileIndexes.end())
+                    continue;
+                sourceFile << R"(os << ")" << nonterminal->name << R"( " << memoProfileHits[)"
+                           << std::get<1>(*iter) << R"(] << " " << memoProfileMisses[)"
+                           << std::get<1>(*iter) << R"(] << "\n";
+)";
+            }
+            if(memoProfileIndexes.empty())
+            {
+                sourceFile << R"(static_cast<void>(os);
+)";
+            }
+            sourceFile << R"(@-}
+
+)";
+        }
+        if(settings.ruleProfile)
+        {
+            sourceFile << R"(std::vector<Parser::RuleProfile> Parser::profile() const
+{
+    static const char *const ruleNames[] = {
+)";
+            for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+            {
+                sourceFile << R"(        ")" << nonterminal->name << R"(",
+)";
+            }
+            sourceFile << R"(    };
+    std::vector<RuleProfile> retval;
+    retval.reserve()" << ruleProfileIndexes.size() << R"();
+    for(std::size_t i = 0; i < )" << ruleProfileIndexes.size() << R"(; i++)
+    {
+        const RuleCounters &counters = ruleCounters[i];
+        retval.push_back(RuleProfile{ruleNames[i],
+        `````````````````````````````counters.invocations,
+        `````````````````````````````counters.memoHits,
+        `````````````````````````````counters.memoMisses,
+        `````````````````````````````counters.successes,
+        `````````````````````````````counters.failures,
+        `````````````````````````````counters.charactersConsumed,
+        `````````````````````````````counters.cycles});
+    }
+    return retval;
+}
+
+void Parser::writeProfileJSON(std::ostream &os) const
 {
+    os << "[";
+    auto seperator = "\n";
+    for(const RuleProfile &ruleProfile : profile())
+    {
+        os << seperator << "    {\"rule\": \"" << ruleProfile.rule
+        ```<< "\", \"invocations\": " << ruleProfile.invocations
+        ```<< ", \"memoHits\": " << ruleProfile.memoHits
+        ```<< ", \"memoMisses\": " << ruleProfile.memoMisses
+        ```<< ", \"successes\": " << ruleProfile.successes
+        ```<< ", \"failures\": " << ruleProfile.failures
+        ```<< ", \"charactersConsumed\": " << ruleProfile.charactersConsumed
+        ```<< ", \"cycles\": " << ruleProfile.cycles << "}";
+        seperator = ",\n";
+    }
+    os << "\n]\n";
 }
 
-Parser::Parser(const char *source, std::size_t sourceSize) : Parser(makeSource(source, sourceSize))
+void Parser::writeProfileCSV(std::ostream &os) const
 {
+    os << "rule,invocations,memoHits,memoMisses,successes,failures,charactersConsumed,cycles\n";
+    for(const RuleProfile &ruleProfile : profile())
+    {
+        os << ruleProfile.rule << "," << ruleProfile.invocations << "," << ruleProfile.memoHits
+        ```<< "," << ruleProfile.memoMisses << "," << ruleProfile.successes << ","
+        ```<< ruleProfile.failures << "," << ruleProfile.charactersConsumed << ","
+        ```<< ruleProfile.cycles << "\n";
+    }
 }
 
-Parser::Parser(const char32_t *source, std::size_t sourceSize)
-    : Parser(makeSource(std::u32string(source, sourceSize)))
+)";
+            if(settings.ruleProfileCycles)
+            {
+                sourceFile << R"(std::uint_least64_t Parser::readCycleCounter() noexcept
 {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#else
+    return static_cast<std::uint_least64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
 }
 
-std::pair<std::shared_ptr<const char32_t>, std::size_t> Parser::makeSource(std::u32string source)
+)";
+            }
+        }
+        if(settings.utf8Input)
+        {
+            sourceFile << R"(Parser::Parser(std::string source) : Parser(makeSource(std::move(source)))
+{
+}
+
+Parser::Parser(const char *source, std::size_t sourceSize)
+    : Parser(makeSource(std::string(source, sourceSize)))
+{
+}
+
+Parser::Parser(const char32_t *source, std::size_t sourceSize) : Parser(makeSource(source, sourceSize))
+{
+}
+
+std::pair<std::shared_ptr<const char>, std::size_t> Parser::makeSource(std::string source)
 {
     auto sourceSize = source.size();
-    auto pSource = std::make_shared<std::u32string>(std::move(source));
-    return std::make_pair(std::shared_ptr<const char32_t>(pSource, pSource->data()), sourceSize);
+    auto pSource = std::make_shared<std::string>(std::move(source));
+    return std::make_pair(std::shared_ptr<const char>(pSource, pSource->data()), sourceSize);
 }
 
-std::pair<std::shared_ptr<const char32_t>, std::size_t> Parser::makeSource(const char *source,
-```````````````````````````````````````````````````````````````````````````std::size_t sourceSize)
+std::pair<std::shared_ptr<const char>, std::size_t> Parser::makeSource(const char32_t *source,
+```````````````````````````````````````````````````````````````````````std::size_t sourceSize)
 {
-    std::u32string retval;
+    std::string retval;
     retval.reserve(sourceSize);
-    std::size_t position = 0;
-    const char32_t replacementChar = U'\uFFFD';
-    while(position < sourceSize)
+    for(std::size_t position = 0; position < sourceSize; position++)
     {
-        unsigned long byte1 = source[position++];
-        if(byte1 < 0x80)
-        {
-            retval += static_cast<char32_t>(byte1);
-            continue;
-        }
-        if(position >= sourceSize || byte1 < 0xC0 || (source[position] & 0xC0) != 0x80)
+        char32_t ch = source[position];
+        if(ch >= 0x110000UL || (ch >= 0xD800 && ch <= 0xDFFF))
+            ch = U'\uFFFD';
+        if(ch < 0x80)
         {
-            retval += replacementChar;
-            continue;
+            retval += static_cast<char>(ch);
         }
-        bool invalid = byte1 < 0xC2 || byte1 > 0xF4;
-        unsigned long byte2 = source[position++];
-        if(byte1 < 0xE0)
+        else if(ch < 0x800)
         {
-            if(invalid)
-                retval += replacementChar;
-            else
-                retval += static_cast<char32_t>(((byte1 & 0x1F) << 6) | (byte2 & 0x3F));
-            continue;
+            retval += static_cast<char>(0xC0 | (ch >> 6));
+            retval += static_cast<char>(0x80 | (ch & 0x3F));
         }
-        if(position >= sourceSize || (source[position] & 0xC0) != 0x80)
+        else if(ch < 0x10000UL)
         {
-            retval += replacementChar;
-            continue;
+            retval += static_cast<char>(0xE0 | (ch >> 12));
+            retval += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            retval += static_cast<char>(0x80 | (ch & 0x3F));
         }
-        unsigned long byte3 = source[position++];
-        if(byte1 < 0xF0)
+        else
         {
-            if(byte1 == 0xE0 && byte2 < 0xA0)
-                invalid = true;
-            if(invalid)
-                retval += replacementChar;
-            else
-                retval += static_cast<char32_t>(((byte1 & 0xF) << 12) | ((byte2 & 0x3F) << 6)
-                                                | (byte3 & 0x3F));
-            continue;
+            retval += static_cast<char>(0xF0 | (ch >> 18));
+            retval += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+            retval += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+            retval += static_cast<char>(0x80 | (ch & 0x3F));
         }
-        if(position >= sourceSize || (source[position] & 0xC0) != 0x80)
-        {
-            retval += replacementChar;
-            continue;
+    }
+    return makeSource(std::move(retval));
+}
+)";
         }
-        unsigned long byte4 = source[position++];
-        if(byte1 == 0xF0 && byte2 < 0x90)
-            invalid = true;
-        if(byte1 == 0xF4 && byte2 > 0x8F)
-            invalid = true;
-        if(byte1 > 0xF4)
-            invalid = true;
-        if(invalid)
-            retval += replacementChar;
         else
-            retval += static_cast<char32_t>(((byte1 & 0x7) << 18) | ((byte2 & 0x3F) << 12)
-                                            | ((byte3 & 0x3F) << 6) | (byte4 & 0x3F));
-    }
+        {
+            sourceFile << R"(Parser::Parser(std::u32string source) : Parser(makeSource(std::move(source)))
+{
+}
+
+Parser::Parser(const char *source, std::size_t sourceSize) : Parser(makeSource(source, sourceSize))
+{
+}
+
+Parser::Parser(const char32_t *source, std::size_t sourceSize)
+    : Parser(makeSource(std::u32string(source, sourceSize)))
+{
+}
+
+std::pair<std::shared_ptr<const char32_t>, std::size_t> Parser::makeSource(std::u32string source)
+{
+    auto sourceSize = source.size();
+    auto pSource = std::make_shared<std::u32string>(std::move(source));
+    return std::make_pair(std::shared_ptr<const char32_t>(pSource, pSource->data()), sourceSize);
+}
+
+std::pair<std::shared_ptr<const char32_t>, std::size_t> Parser::makeSource(const char *source,
+```````````````````````````````````````````````````````````````````````````std::size_t sourceSize)
+{
+    std::u32string retval;
+    retval.reserve(sourceSize);
+    std::size_t position = 0;
+    while(position < sourceSize)
+        retval += decodeUTF8(source, sourceSize, position);
     return makeSource(std::move(retval));
 }
 )";
+        }
         for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
         {
             writeTemplateDeclaration(headerFile, nonterminal->templateArguments, "    ");
-            headerFile << "    " << nonterminal->type->code << " "
+            headerFile << "    " << getInternalParseReturnType(nonterminal) << " "
                        << makeInternalParseFunctionName(nonterminal->name)
                        << "(std::size_t startLocation, RuleResult &ruleResult, bool "
                           "isRequiredForSuccess);\n";
+            if(isReplayed(nonterminal))
+            {
+                writeTemplateDeclaration(headerFile, nonterminal->templateArguments, "    ");
+                headerFile << "    " << nonterminal->type->code << " "
+                           << makeReplayFunctionName(nonterminal->name)
+                           << "(std::size_t startLocation, std::size_t &location);\n";
+            }
+            std::string templateArgumentNames = makeTemplateArgumentNames(nonterminal);
+            std::string replayStatements;
+            if(isReplayed(nonterminal))
+            {
+                replayStatements =
+                    "    this->actionTapePosition = 0;\n"
+                    "    std::size_t location = 0;\n"
+                    "    "
+                    + std::string(nonterminal->type->isVoid ? "" : "auto value = ")
+                    + "this->" + makeReplayFunctionName(nonterminal->name) + templateArgumentNames
+                    + "(0, location);\n"
+                      "    assert(location == result.location\n"
+                      "    ```````&& this->actionTapePosition == this->actionTape.size());\n";
+            }
+            std::string valueArenaScopeStatement;
+            if(settings.valueArena)
+                valueArenaScopeStatement = "    ValueArena::Scope valueArenaScope(valueArena);\n";
             sourceFile << R"(
 )";
             writeTemplateDeclaration(sourceFile, nonterminal->templateArguments);
-            sourceFile << nonterminal->type->code << R"( Parser::)"
-                       << makeParseFunctionName(nonterminal->name) << R"(()
+            // definitions outside the class use trailing return types so that the rule's type is
+            // looked up in the class's scope, like in the declarations
+            sourceFile << R"(auto Parser::)" << makeParseFunctionName(nonterminal->name)
+                       << R"(() -> )" << nonterminal->type->code << R"(
 {
-    RuleResult result;
-    )" << (nonterminal->type->isVoid ? "" : "auto retval = ")
-                       << makeInternalParseFunctionName(nonterminal->name);
-            if(!nonterminal->templateArguments.empty())
+)" << valueArenaScopeStatement << R"(    RuleResult result;
+)";
+            if(isReplayed(nonterminal))
             {
-                sourceFile << "<";
-                auto seperator = "";
-                for(auto templateArgument : nonterminal->templateArguments)
-                {
-                    sourceFile << seperator << templateArgument->name;
-                    seperator = ", ";
-                }
-                sourceFile << ">";
+                sourceFile << R"(    this->actionTape.clear();
+)";
             }
-            sourceFile << R"((0, result, true);
+            sourceFile << "    "
+                       << (nonterminal->type->isVoid || isDeferred(nonterminal) ? "" :
+                                                                                  "auto value = ")
+                       << makeInternalParseFunctionName(nonterminal->name) << templateArgumentNames
+                       << R"((0, result, true);
     assert(!result.empty());
     if(result.fail())
         throw ParseError(errorLocation, errorMessage);
-)";
+)" << replayStatements;
             if(!nonterminal->type->isVoid)
             {
-                sourceFile << R"(    return retval;
+                sourceFile << R"(    return value;
 )";
             }
             sourceFile << R"(}
 
+)";
+            writeTemplateDeclaration(sourceFile, nonterminal->templateArguments);
+            sourceFile << R"(auto Parser::)" << makeTryParseFunctionName(nonterminal->name)
+                       << R"(() -> )" << makeTryParseResultType(nonterminal) << R"(
+{
+)" << valueArenaScopeStatement << "    " << makeTryParseResultType(nonterminal) << R"( retval;
+    RuleResult result;
+)";
+            if(isReplayed(nonterminal))
+            {
+                sourceFile << R"(    this->actionTape.clear();
+)";
+            }
+            sourceFile << "    "
+                       << (nonterminal->type->isVoid || isDeferred(nonterminal) ? "" :
+                                                                                  "auto value = ")
+                       << makeInternalParseFunctionName(nonterminal->name) << templateArgumentNames
+                       << R"((0, result, true);
+    assert(!result.empty());
+    if(result.fail())
+    {
+        retval.location = errorLocation;
+        retval.message = errorMessage;
+        return retval;
+    }
+    retval.location = result.location;
+)" << replayStatements;
+            if(!nonterminal->type->isVoid)
+            {
+                sourceFile << R"(    retval.value = std::move(value);
+)";
+            }
+            sourceFile << R"(    return retval;
+}
+
 )";
             writeTemplateDeclaration(sourceFile, nonterminal->templateArguments);
             sourceFile
-                << nonterminal->type->code << R"( Parser::)"
-                << makeInternalParseFunctionName(nonterminal->name)
-                << R"((std::size_t startLocation__, RuleResult &ruleResultOut__, bool isRequiredForSuccess__)
+                << R"(auto Parser::)" << makeInternalParseFunctionName(nonterminal->name)
+                << R"((std::size_t startLocation__, RuleResult &ruleResultOut__, bool isRequiredForSuccess__) -> )"
+                << getInternalParseReturnType(nonterminal) << R"(
 {
 @+)";
-            if(!nonterminal->type->isVoid)
+            auto ruleProfileIndex = ruleProfileIndexes.find(nonterminal);
+            if(ruleProfileIndex != ruleProfileIndexes.end())
+            {
+                sourceFile << R"(RuleProfileScope ruleProfileScope__(this->ruleCounters[)"
+                           << std::get<1>(*ruleProfileIndex)
+                           << R"(], ruleResultOut__, startLocation__);
+)";
+            }
+            // deferred rules get their value when they're replayed
+            bool returnsValue = !nonterminal->type->isVoid && !isDeferred(nonterminal);
+            if(returnsValue)
             {
                 sourceFile << nonterminal->type->code << R"( returnValue__{};
 )";
             }
             this->nonterminal = nonterminal;
             needsIsRequiredForSuccess = false;
-            state = State::DeclareLocals;
-            nonterminal->expression->visit(*this);
+            visibleNames = ruleNames.at(nonterminal).declaredNames;
+            backtrackPointCount = 0;
+            choiceBacktrackPointName.clear();
+            choiceDispatchCount = 0;
+            actionTapeMarkCount = 0;
+            if(!isDeferred(nonterminal))
+            {
+                state = State::DeclareLocals;
+                nonterminal->expression->visit(*this);
+            }
             if(nonterminal->settings.caching)
             {
                 needsIsRequiredForSuccess = true;
-                sourceFile << R"(auto &ruleResult__ = this->getResults(startLocation__).)"
-                           << makeResultVariableName(nonterminal->name);
-                for(auto templateArgument : nonterminal->templateArguments)
+                auto memoProfileIndex = memoProfileIndexes.find(nonterminal);
+                auto countMemoHit = [&](const char *indent) -> std::string
                 {
-                    sourceFile << "[static_cast<std::size_t>(" << templateArgument->name << ")]";
-                }
-                sourceFile << R"(;
-if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__))
+                    std::string retval;
+                    if(memoProfileIndex != memoProfileIndexes.end())
+                        retval += indent + ("this->memoProfileHits["
+                                            + std::to_string(std::get<1>(*memoProfileIndex))
+                                            + "]++;\n");
+                    if(ruleProfileIndex != ruleProfileIndexes.end())
+                        retval += indent + ("this->ruleCounters["
+                                            + std::to_string(std::get<1>(*ruleProfileIndex))
+                                            + "].memoHits++;\n");
+                    return retval;
+                };
+                if(memoWriteBack)
+                {
+                    sourceFile << R"(Parser::RuleResult ruleResult__;
+if(const Results *results__ = this->findResults(startLocation__))
 {
-    ruleResultOut__ = ruleResult__;
 )";
-                if(nonterminal->type->isVoid)
+                    auto cachedResult = "results__->" + makeResultVariableName(nonterminal->name)
+                                        + makeResultSubscript(nonterminal);
+                    if(settings.compactMemo)
+                        sourceFile << R"(    const Parser::RuleResult cachedRuleResult__ = this->loadRuleResult()"
+                                   << cachedResult << R"(, startLocation__);
+)";
+                    else
+                        sourceFile << R"(    const Parser::RuleResult &cachedRuleResult__ = )"
+                                   << cachedResult << R"(;
+)";
+                    if(memoizesValue(nonterminal))
+                    {
+                        auto hasValue = "results__->"
+                                        + makeHasValueVariableName(nonterminal->name)
+                                        + makeResultSubscript(nonterminal);
+                        sourceFile << R"(    if(!cachedRuleResult__.empty()
+    ```&& (cachedRuleResult__.fail() || !isRequiredForSuccess__ || )"
+                                   << hasValue << R"())
+    {
+)" << countMemoHit("        ") << R"(        ruleResultOut__ = cachedRuleResult__;
+        if()" << hasValue << R"()
+            return results__->)" << makeValueVariableName(nonterminal->name)
+                                   << makeResultSubscript(nonterminal) << R"(;
+        return returnValue__;
+    }
+}
+)";
+                    }
+                    else
+                    {
+                        sourceFile << R"(    if(!cachedRuleResult__.empty() && (cachedRuleResult__.fail() || !isRequiredForSuccess__))
+    {
+)" << countMemoHit("        ") << R"(        ruleResultOut__ = cachedRuleResult__;
+        return)" << (returnsValue ? " returnValue__" : "") << R"(;
+    }
+}
+)";
+                    }
+                }
+                else if(memoizesValue(nonterminal))
                 {
-                    sourceFile << R"(    return;
+                    auto hasValue = "results__." + makeHasValueVariableName(nonterminal->name)
+                                    + makeResultSubscript(nonterminal);
+                    sourceFile << R"(auto &results__ = this->getResults(startLocation__);
+auto &ruleResult__ = results__.)" << makeResultVariableName(nonterminal->name)
+                               << makeResultSubscript(nonterminal) << R"(;
+if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__ || )"
+                               << hasValue << R"())
+{
+)" << countMemoHit("    ") << R"(    ruleResultOut__ = ruleResult__;
+    if()" << hasValue << R"()
+        return results__.)" << makeValueVariableName(nonterminal->name)
+                               << makeResultSubscript(nonterminal) << R"(;
+    return returnValue__;
 }
 )";
                 }
                 else
                 {
-                    sourceFile << R"(    return returnValue__;
+                    sourceFile << R"(auto &ruleResult__ = this->getResults(startLocation__).)"
+                               << makeResultVariableName(nonterminal->name)
+                               << makeResultSubscript(nonterminal) << R"(;
+if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__))
+{
+)" << countMemoHit("    ") << R"(    ruleResultOut__ = ruleResult__;
+)";
+                    if(!returnsValue)
+                    {
+                        sourceFile << R"(    return;
+}
+)";
+                    }
+                    else
+                    {
+                        sourceFile << R"(    return returnValue__;
 }
 )";
+                    }
+                }
+                if(memoProfileIndex != memoProfileIndexes.end())
+                {
+                    sourceFile << "this->memoProfileMisses["
+                               << std::get<1>(*memoProfileIndex) << "]++;\n";
+                }
+                if(ruleProfileIndex != ruleProfileIndexes.end())
+                {
+                    sourceFile << "this->ruleCounters[" << std::get<1>(*ruleProfileIndex)
+                               << "].memoMisses++;\n";
                 }
             }
             else
@@ -944,34 +4103,68 @@ if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__))
             }
             this->nonterminal = nonterminal;
             state = State::ParseAndEvaluateFunction;
-            nonterminal->expression->visit(*this);
+            isRecordingActionTape = isReplayed(nonterminal);
+            writeParse(nonterminal->expression);
+            isRecordingActionTape = false;
             if(!needsIsRequiredForSuccess)
             {
                 sourceFile << R"(static_cast<void>(isRequiredForSuccess__);
 )";
             }
-            if(nonterminal->type->name == "char")
+            if(returnsValue)
+                writeCharacterRuleReturnValue(nonterminal);
+            if(nonterminal->settings.caching && memoWriteBack)
             {
-                if(auto characterClass =
-                       dynamic_cast<ast::CharacterClass *>(nonterminal->expression))
+                sourceFile << R"(if(Results *results__ = this->getResults(startLocation__))
+)";
+                auto storeResult = settings.compactMemo ?
+                                       "this->storeRuleResult(results__->"
+                                           + makeResultVariableName(nonterminal->name)
+                                           + makeResultSubscript(nonterminal)
+                                           + ", ruleResult__, startLocation__);\n" :
+                                       "results__->" + makeResultVariableName(nonterminal->name)
+                                           + makeResultSubscript(nonterminal)
+                                           + " = ruleResult__;\n";
+                if(memoizesValue(nonterminal))
                 {
-                    if(characterClass->variableName.empty())
-                    {
-                        sourceFile << R"(if(ruleResult__.success())
-    returnValue__ = this->source.get()[startLocation__];
+                    sourceFile << R"({
+    )" << storeResult << R"(    if(ruleResult__.success() && isRequiredForSuccess__)
+    {
+        results__->)" << makeValueVariableName(nonterminal->name)
+                               << makeResultSubscript(nonterminal) << R"( = returnValue__;
+        results__->)" << makeHasValueVariableName(nonterminal->name)
+                               << makeResultSubscript(nonterminal) << R"( = true;
+    }
+}
 )";
-                    }
                 }
+                else
+                {
+                    sourceFile << "    " << storeResult;
+                }
+            }
+            else if(nonterminal->settings.caching && memoizesValue(nonterminal))
+            {
+                sourceFile << R"(if(ruleResult__.success() && isRequiredForSuccess__)
+{
+    results__.)" << makeValueVariableName(nonterminal->name)
+                           << makeResultSubscript(nonterminal) << R"( = returnValue__;
+    results__.)" << makeHasValueVariableName(nonterminal->name)
+                           << makeResultSubscript(nonterminal) << R"( = true;
+}
+)";
             }
             sourceFile << R"(ruleResultOut__ = ruleResult__;
 )";
-            if(!nonterminal->type->isVoid)
+            if(returnsValue)
             {
                 sourceFile << R"(return returnValue__;
 )";
             }
             sourceFile << R"(@-}
 )";
+            if(isReplayed(nonterminal))
+                writeReplayFunction(nonterminal);
         }
         headerFile << R"(};
 )";
@@ -990,23 +4183,35 @@ if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__))
             templateArgumentValueIndexes.assign(nonterminal->templateArguments.size(), 0);
             for(bool done = false; !done;)
             {
-                std::ostringstream parseFunctionStream, internalParseFunctionStream;
-                parseFunctionStream << "template " << nonterminal->type->code << " Parser::";
-                internalParseFunctionStream << "template " << nonterminal->type->code
-                                            << " Parser::";
+                std::ostringstream parseFunctionStream, tryParseFunctionStream,
+                    internalParseFunctionStream;
+                parseFunctionStream << "template auto Parser::";
+                tryParseFunctionStream << "template auto Parser::";
+                internalParseFunctionStream << "template auto Parser::";
                 parseFunctionStream << makeParseFunctionName(nonterminal->name);
+                tryParseFunctionStream << makeTryParseFunctionName(nonterminal->name);
                 internalParseFunctionStream << makeInternalParseFunctionName(nonterminal->name);
                 parseFunctionStream << "<";
+                tryParseFunctionStream << "<";
                 internalParseFunctionStream << "<";
+                std::string templateArgumentValues;
                 auto seperator = "";
                 for(std::size_t i = 0; i < nonterminal->templateArguments.size(); i++)
                 {
                     assert(templateArgumentValueIndexes[i]
                            < nonterminal->templateArguments[i]->type->values.size());
+                    templateArgumentValues += seperator
+                                              + nonterminal->templateArguments[i]
+                                                    ->type->values[templateArgumentValueIndexes[i]]
+                                                    ->code;
                     parseFunctionStream << seperator
                                         << nonterminal->templateArguments[i]
                                                ->type->values[templateArgumentValueIndexes[i]]
                                                ->code;
+                    tryParseFunctionStream << seperator
+                                           << nonterminal->templateArguments[i]
+                                                  ->type->values[templateArgumentValueIndexes[i]]
+                                                  ->code;
                     internalParseFunctionStream
                         << seperator
                         << nonterminal->templateArguments[i]
@@ -1014,12 +4219,26 @@ if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__))
                                ->code;
                     seperator = ", ";
                 }
-                parseFunctionStream << ">();\n";
+                parseFunctionStream << ">() -> " << nonterminal->type->code << ";\n";
+                tryParseFunctionStream << ">() -> " << makeTryParseResultType(nonterminal) << ";\n";
                 internalParseFunctionStream << ">(std::size_t startLocation, RuleResult "
-                                               "&ruleResultOut, bool isRequiredForSuccess);\n";
+                                               "&ruleResultOut, bool isRequiredForSuccess) -> "
+                                            << getInternalParseReturnType(nonterminal) << ";\n";
                 headerFile << "extern " << parseFunctionStream.str()
+                           << "extern " << tryParseFunctionStream.str()
                            << "extern " << internalParseFunctionStream.str();
-                sourceFile << parseFunctionStream.str() << internalParseFunctionStream.str();
+                sourceFile << parseFunctionStream.str() << tryParseFunctionStream.str()
+                           << internalParseFunctionStream.str();
+                if(isReplayed(nonterminal))
+                {
+                    std::string replayFunction =
+                        "template auto Parser::" + makeReplayFunctionName(nonterminal->name) + "<"
+                        + templateArgumentValues
+                        + ">(std::size_t startLocation, std::size_t &location) -> "
+                        + nonterminal->type->code + ";\n";
+                    headerFile << "extern " << replayFunction;
+                    sourceFile << replayFunction;
+                }
                 for(std::size_t i = nonterminal->templateArguments.size(); i > 0; i--)
                 {
                     templateArgumentValueIndexes[i - 1]++;
@@ -1064,6 +4283,31 @@ if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__))
             sourceFile << R"(ruleResult__ = this->makeSuccess(startLocation__);
     )";
             break;
+        case State::ReplayFunction:
+            assert(false);
+            break;
+        }
+    }
+    virtual void visitCut(ast::Cut *node) override
+    {
+        switch(state)
+        {
+        case State::DeclareLocals:
+            break;
+        case State::ParseAndEvaluateFunction:
+            sourceFile << R"(ruleResult__ = this->makeSuccess(startLocation__);
+)";
+            if(!choiceBacktrackPointName.empty())
+            {
+                sourceFile << choiceBacktrackPointName << R"(.cut();
+)";
+            }
+            sourceFile << R"(this->commitCut(startLocation__);
+)";
+            break;
+        case State::ReplayFunction:
+            assert(false);
+            break;
         }
     }
     virtual void visitGrammar(ast::Grammar *node) override
@@ -1074,6 +4318,81 @@ if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__))
     {
         assert(false);
     }
+    // the rule's body goes in a nested block that shadows the caller's locals; the outer block
+    // copies what the body needs first, since a declaration can't be initialized from a variable
+    // it shadows
+    void writeInlinedNonterminal(ast::NonterminalExpression *node)
+    {
+        const ast::Nonterminal *nonterminal = node->value;
+        needsIsRequiredForSuccess = true;
+        sourceFile << R"({
+    std::size_t inlineStartLocation__ = startLocation__;
+    bool inlineIsRequiredForSuccess__ = isRequiredForSuccess__;
+)";
+        if(!node->variableName.empty())
+        {
+            sourceFile << "    " << nonterminal->type->code << " &inlineValue__ = "
+                       << node->variableName << ";\n";
+        }
+        for(std::size_t i = 0; i < node->templateArguments.size(); i++)
+        {
+            if(isTemplateArgumentPassedThrough(node, i))
+                continue;
+            sourceFile << "    constexpr " << nonterminal->templateArguments[i]->type->code
+                       << " inlineTemplateArgument" << i << "__ = "
+                       << node->templateArguments[i]->getCode() << ";\n";
+        }
+        sourceFile << R"(    {
+        std::size_t startLocation__ = inlineStartLocation__;
+        bool isRequiredForSuccess__ = inlineIsRequiredForSuccess__;
+@+@+)";
+        for(std::size_t i = 0; i < node->templateArguments.size(); i++)
+        {
+            if(isTemplateArgumentPassedThrough(node, i))
+                continue;
+            sourceFile << "constexpr " << nonterminal->templateArguments[i]->type->code << " "
+                       << nonterminal->templateArguments[i]->name << " = inlineTemplateArgument"
+                       << i << "__;\n";
+        }
+        if(!nonterminal->type->isVoid)
+        {
+            sourceFile << nonterminal->type->code << R"( returnValue__{};
+)";
+        }
+        std::string savedChoiceBacktrackPointName = std::move(choiceBacktrackPointName);
+        choiceBacktrackPointName.clear();
+        std::set<std::string> savedVisibleNames = visibleNames;
+        const RuleNames &names = ruleNames.at(nonterminal);
+        visibleNames.insert(names.declaredNames.begin(), names.declaredNames.end());
+        needsIsRequiredForSuccess = false;
+        state = State::DeclareLocals;
+        nonterminal->expression->visit(*this);
+        state = State::ParseAndEvaluateFunction;
+        nonterminal->expression->visit(*this);
+        if(!needsIsRequiredForSuccess)
+        {
+            sourceFile << R"(static_cast<void>(isRequiredForSuccess__);
+)";
+        }
+        writeCharacterRuleReturnValue(nonterminal);
+        if(!node->variableName.empty())
+        {
+            sourceFile << R"(inlineValue__ = std::move(returnValue__);
+)";
+        }
+        else if(!nonterminal->type->isVoid)
+        {
+            sourceFile << R"(static_cast<void>(returnValue__);
+)";
+        }
+        needsIsRequiredForSuccess = true;
+        choiceBacktrackPointName = std::move(savedChoiceBacktrackPointName);
+        visibleNames = std::move(savedVisibleNames);
+        sourceFile << R"(@-@-    }
+}
+assert(!ruleResult__.empty());
+)";
+    }
     virtual void visitNonterminalExpression(ast::NonterminalExpression *node) override
     {
         switch(state)
@@ -1086,28 +4405,44 @@ if(!ruleResult__.empty() && (ruleResult__.fail() || !isRequiredForSuccess__))
             }
             break;
         case State::ParseAndEvaluateFunction:
+            if(canInline(node))
+            {
+                writeInlinedNonterminal(node);
+                break;
+            }
             sourceFile << R"(ruleResult__ = Parser::RuleResult();
 )";
-            if(!node->variableName.empty())
+            if(!node->variableName.empty() && !isDeferred(nonterminal))
             {
                 sourceFile << node->variableName << R"( = )";
             }
             needsIsRequiredForSuccess = true;
-            sourceFile << R"(this->)" << makeInternalParseFunctionName(node->value->name);
-            if(!node->templateArguments.empty())
+            sourceFile << R"(this->)" << makeInternalParseFunctionName(node->value->name)
+                       << makeTemplateArgumentValues(node) << R"((startLocation__, ruleResult__, isRequiredForSuccess__);
+assert(!ruleResult__.empty());
+)";
+            break;
+        case State::ReplayFunction:
+            if(isReplayed(node->value))
             {
-                sourceFile << "<";
-                auto seperator = "";
-                for(auto templateArgument : node->templateArguments)
+                if(!node->variableName.empty())
                 {
-                    sourceFile << seperator;
-                    seperator = ", ";
-                    sourceFile << templateArgument->getCode();
+                    sourceFile << node->variableName << R"( = )";
                 }
-                sourceFile << ">";
+                sourceFile << R"(this->)" << makeReplayFunctionName(node->value->name)
+                           << makeTemplateArgumentValues(node) << R"((startLocation__, location__);
+)";
+                break;
             }
-            sourceFile << R"((startLocation__, ruleResult__, isRequiredForSuccess__);
-assert(!ruleResult__.empty());
+            // rules that run their actions while parsing are parsed again for their value
+            sourceFile << R"({
+    Parser::RuleResult ruleResult__;
+    )" << node->variableName << R"( = this->)"
+                       << makeInternalParseFunctionName(node->value->name)
+                       << makeTemplateArgumentValues(node) << R"((startLocation__, ruleResult__, true);
+    assert(ruleResult__.success());
+    location__ = ruleResult__.location;
+}
 )";
             break;
         }
@@ -1121,13 +4456,83 @@ assert(!ruleResult__.empty());
             node->second->visit(*this);
             break;
         case State::ParseAndEvaluateFunction:
-            node->first->visit(*this);
-            sourceFile << R"(if(ruleResult__.fail())
+        {
+            std::vector<ast::Expression *> alternatives = getAlternatives(node);
+            // the tape holds the index of the alternative that matched
+            std::string actionTapeMarkName;
+            if(isRecordingActionTape)
+            {
+                actionTapeMarkName = makeActionTapeMarkName();
+                sourceFile << R"(std::size_t )" << actionTapeMarkName << R"( = this->actionTape.size();
+this->actionTape.push_back(0);
+)";
+            }
+            std::vector<SkippedFailure> skippedFailures;
+            for(ast::Expression *alternative : alternatives)
+                skippedFailures.push_back(getSkippedFailure(alternative));
+            auto dispatchName = beginChoiceDispatch(alternatives, skippedFailures);
+            auto getDispatchCondition = [&](std::size_t index) -> std::string
+            {
+                if(dispatchName.empty() || index >= 64)
+                    return "";
+                return "(" + dispatchName + " & "
+                       + makeAlternativeMask(static_cast<std::uint_fast64_t>(1) << index) + ")";
+            };
+            auto savedChoiceBacktrackPointName = choiceBacktrackPointName;
+            if(hasCuts)
+                choiceBacktrackPointName = beginBacktrackPoint();
+            if(getDispatchCondition(0).empty())
+            {
+                writeParse(alternatives.front());
+            }
+            else
+            {
+                sourceFile << R"(if)" << getDispatchCondition(0) << R"(
+{
+@+)";
+                writeParse(alternatives.front());
+                sourceFile << R"(@-}
+else
+{
+    )" << makeSkippedFailureStatement(skippedFailures.front())
+                           << R"(
+}
+)";
+            }
+            for(std::size_t i = 1; i < alternatives.size(); i++)
+            {
+                std::string dispatchCondition = getDispatchCondition(i);
+                if(!dispatchCondition.empty())
+                    dispatchCondition = " && " + dispatchCondition;
+                if(hasCuts)
+                {
+                    sourceFile << R"(if(ruleResult__.fail() && )" << choiceBacktrackPointName
+                               << R"(.isActive())" << dispatchCondition << R"()
+{
+    Parser::RuleResult lastRuleResult__ = ruleResult__;
+)";
+                    if(i == alternatives.size() - 1)
+                    {
+                        sourceFile << R"(    )" << choiceBacktrackPointName << R"(.cut();
+)";
+                    }
+                    sourceFile << R"(@+)";
+                }
+                else
+                {
+                    sourceFile << R"(if(ruleResult__.fail())" << dispatchCondition << R"()
 {
     Parser::RuleResult lastRuleResult__ = ruleResult__;
 @+)";
-            node->second->visit(*this);
-            sourceFile << R"(@_if(ruleResult__.success())
+                }
+                if(!actionTapeMarkName.empty())
+                {
+                    sourceFile << R"(this->actionTape.resize()" << actionTapeMarkName << R"( + 1);
+this->actionTape[)" << actionTapeMarkName << R"(] = )" << i << R"(;
+)";
+                }
+                writeParse(alternatives[i]);
+                sourceFile << R"(@_if(ruleResult__.success())
     {
         if(lastRuleResult__.endLocation >= ruleResult__.endLocation)
         {
@@ -1135,9 +4540,53 @@ assert(!ruleResult__.empty());
         }
     }
 }
+)";
+                if(!dispatchCondition.empty())
+                {
+                    sourceFile << R"(else if(ruleResult__.fail())";
+                    if(hasCuts)
+                        sourceFile << R"( && )" << choiceBacktrackPointName << R"(.isActive())";
+                    sourceFile << R"()
+{
+    )" << makeSkippedFailureStatement(skippedFailures[i])
+                               << R"(
+}
+)";
+                }
+            }
+            if(hasCuts)
+                endBacktrackPoint();
+            if(!dispatchName.empty())
+                endChoiceDispatch();
+            choiceBacktrackPointName = savedChoiceBacktrackPointName;
+            break;
+        }
+        case State::ReplayFunction:
+        {
+            std::vector<ast::Expression *> alternatives = getAlternatives(node);
+            sourceFile << R"(switch(this->actionTape[this->actionTapePosition++])
+{
+)";
+            for(std::size_t i = 0; i < alternatives.size(); i++)
+            {
+                if(i + 1 < alternatives.size())
+                    sourceFile << R"(case )" << i << R"(:
+)";
+                else
+                    sourceFile << R"(default:
+)";
+                sourceFile << R"({
+@+)";
+                writeReplay(alternatives[i]);
+                sourceFile << R"(break;
+@-}
+)";
+            }
+            sourceFile << R"(}
 )";
             break;
         }
+        }
     }
     virtual void visitFollowedByPredicate(ast::FollowedByPredicate *node) override
     {
@@ -1147,12 +4596,27 @@ assert(!ruleResult__.empty());
             node->expression->visit(*this);
             break;
         case State::ParseAndEvaluateFunction:
-            node->expression->visit(*this);
+        {
+            std::string actionTapeMarkName = beginPredicateActionTape(node);
+            // a cut inside the predicate only commits to choices inside the predicate
+            std::string savedChoiceBacktrackPointName = std::move(choiceBacktrackPointName);
+            choiceBacktrackPointName.clear();
+            if(hasCuts)
+                beginBacktrackPoint();
+            writeParse(node->expression);
+            if(hasCuts)
+                endBacktrackPoint();
+            choiceBacktrackPointName = std::move(savedChoiceBacktrackPointName);
+            endPredicateActionTape(actionTapeMarkName);
             sourceFile << R"(if(ruleResult__.success())
     ruleResult__.location = startLocation__;
 )";
             break;
         }
+        case State::ReplayFunction:
+            assert(false);
+            break;
+        }
     }
     virtual void visitNotFollowedByPredicate(ast::NotFollowedByPredicate *node) override
     {
@@ -1162,10 +4626,20 @@ assert(!ruleResult__.empty());
             node->expression->visit(*this);
             break;
         case State::ParseAndEvaluateFunction:
+        {
             needsIsRequiredForSuccess = true;
             sourceFile << R"(isRequiredForSuccess__ = !isRequiredForSuccess__;
 )";
-            node->expression->visit(*this);
+            std::string actionTapeMarkName = beginPredicateActionTape(node);
+            std::string savedChoiceBacktrackPointName = std::move(choiceBacktrackPointName);
+            choiceBacktrackPointName.clear();
+            if(hasCuts)
+                beginBacktrackPoint();
+            writeParse(node->expression);
+            if(hasCuts)
+                endBacktrackPoint();
+            choiceBacktrackPointName = std::move(savedChoiceBacktrackPointName);
+            endPredicateActionTape(actionTapeMarkName);
             sourceFile << R"(isRequiredForSuccess__ = !isRequiredForSuccess__;
 if(ruleResult__.success())
     ruleResult__ = this->makeFail(startLocation__, "not allowed here", isRequiredForSuccess__);
@@ -1174,6 +4648,10 @@ else
 )";
             break;
         }
+        case State::ReplayFunction:
+            assert(false);
+            break;
+        }
     }
     virtual void visitCustomPredicate(ast::CustomPredicate *node) override
     {
@@ -1193,6 +4671,9 @@ else
 }
 )";
             break;
+        case State::ReplayFunction:
+            assert(false);
+            break;
         }
     }
     virtual void visitGreedyRepetition(ast::GreedyRepetition *node) override
@@ -1203,6 +4684,11 @@ else
             node->expression->visit(*this);
             break;
         case State::ParseAndEvaluateFunction:
+        {
+            if(writeCharacterRepetition(node->expression, false))
+                break;
+            bool isLiteralScan = beginLiteralScanRepetition(node->expression, false);
+            std::string actionTapeMarkName = beginRepetitionActionTape();
             sourceFile << R"(ruleResult__ = this->makeSuccess(startLocation__);
 {
     auto savedStartLocation__ = startLocation__;
@@ -1212,7 +4698,13 @@ else
         Parser::RuleResult ruleResult__;
         startLocation__ = savedRuleResult__.location;
 @+@+)";
-            node->expression->visit(*this);
+            if(hasCuts)
+            {
+                sourceFile << R"(Parser::BacktrackPoint )" << makeBacktrackPointName()
+                           << R"((*this, startLocation__);
+)";
+            }
+            writeRepetitionIteration(node->expression, actionTapeMarkName);
             sourceFile << R"(@_@_if(ruleResult__.fail() || ruleResult__.location == startLocation__)
         {
             savedRuleResult__ = this->makeSuccess(savedRuleResult__.location, ruleResult__.endLocation);
@@ -1223,6 +4715,15 @@ else
     }
 }
 )";
+            if(isLiteralScan)
+            {
+                sourceFile << R"(@-}
+)";
+            }
+            break;
+        }
+        case State::ReplayFunction:
+            writeRepetitionReplay(node->expression);
             break;
         }
     }
@@ -1234,17 +4735,34 @@ else
             node->expression->visit(*this);
             break;
         case State::ParseAndEvaluateFunction:
-            node->expression->visit(*this);
+        {
+            if(writeCharacterRepetition(node->expression, true))
+                break;
+            bool isLiteralScan = beginLiteralScanRepetition(node->expression, true);
+            std::string actionTapeMarkName = beginRepetitionActionTape();
+            writeParse(node->expression);
             sourceFile << R"(if(ruleResult__.success())
 {
-    auto savedStartLocation__ = startLocation__;
+)";
+            if(!actionTapeMarkName.empty())
+            {
+                sourceFile << R"(    this->actionTape[)" << actionTapeMarkName << R"(]++;
+)";
+            }
+            sourceFile << R"(    auto savedStartLocation__ = startLocation__;
     auto &savedRuleResult__ = ruleResult__;
     while(true)
     {
         Parser::RuleResult ruleResult__;
         startLocation__ = savedRuleResult__.location;
 @+@+)";
-            node->expression->visit(*this);
+            if(hasCuts)
+            {
+                sourceFile << R"(Parser::BacktrackPoint )" << makeBacktrackPointName()
+                           << R"((*this, startLocation__);
+)";
+            }
+            writeRepetitionIteration(node->expression, actionTapeMarkName);
             sourceFile << R"(@_@_if(ruleResult__.fail() || ruleResult__.location == startLocation__)
         {
             savedRuleResult__ = this->makeSuccess(savedRuleResult__.location, ruleResult__.endLocation);
@@ -1255,6 +4773,15 @@ else
     }
 }
 )";
+            if(isLiteralScan)
+            {
+                sourceFile << R"(@-}
+)";
+            }
+            break;
+        }
+        case State::ReplayFunction:
+            writeRepetitionReplay(node->expression);
             break;
         }
     }
@@ -1266,9 +4793,49 @@ else
             node->expression->visit(*this);
             break;
         case State::ParseAndEvaluateFunction:
-            node->expression->visit(*this);
-            sourceFile << R"(if(ruleResult__.fail())
+        {
+            // the tape holds whether the expression matched
+            std::string actionTapeMarkName;
+            if(isRecordingActionTape)
+            {
+                actionTapeMarkName = makeActionTapeMarkName();
+                sourceFile << R"(std::size_t )" << actionTapeMarkName << R"( = this->actionTape.size();
+this->actionTape.push_back(1);
+)";
+            }
+            if(hasCuts)
+                beginBacktrackPoint();
+            writeParse(node->expression);
+            if(hasCuts)
+                endBacktrackPoint();
+            if(!actionTapeMarkName.empty())
+            {
+                sourceFile << R"(if(ruleResult__.fail())
+{
+    this->actionTape.resize()" << actionTapeMarkName << R"( + 1);
+    this->actionTape[)" << actionTapeMarkName << R"(] = 0;
+    ruleResult__ = this->makeSuccess(startLocation__);
+}
+)";
+            }
+            else
+            {
+                sourceFile << R"(if(ruleResult__.fail())
     ruleResult__ = this->makeSuccess(startLocation__);
+)";
+            }
+            break;
+        }
+        case State::ReplayFunction:
+            sourceFile << R"(if(this->actionTape[this->actionTapePosition++] != 0)
+{
+@+)";
+            writeReplay(node->expression);
+            sourceFile << R"(@-}
+else
+{
+    location__ = startLocation__;
+}
 )";
             break;
         }
@@ -1282,13 +4849,24 @@ else
             node->second->visit(*this);
             break;
         case State::ParseAndEvaluateFunction:
-            node->first->visit(*this);
+            writeParse(node->first);
             sourceFile << R"(if(ruleResult__.success())
 {
     auto savedStartLocation__ = startLocation__;
     startLocation__ = ruleResult__.location;
 @+)";
-            node->second->visit(*this);
+            writeParse(node->second);
+            sourceFile << R"(@_startLocation__ = savedStartLocation__;
+}
+)";
+            break;
+        case State::ReplayFunction:
+            writeReplay(node->first);
+            sourceFile << R"({
+    auto savedStartLocation__ = startLocation__;
+    startLocation__ = location__;
+@+)";
+            writeReplay(node->second);
             sourceFile << R"(@_startLocation__ = savedStartLocation__;
 }
 )";
@@ -1308,17 +4886,154 @@ else
     ruleResult__ = this->makeFail(startLocation__, "missing )"
                        << escapeString(getCharName(node->value)) << R"(", isRequiredForSuccess__);
 }
-else if(this->source.get()[startLocation__] == U')" << escapeChar(node->value) << R"(')
+)";
+            if(settings.utf8Input && node->value >= 0x80)
+            {
+                std::string bytes = encodeUTF8(node->value);
+                sourceFile << R"(else if(this->sourceSize - startLocation__ >= )" << bytes.size();
+                for(std::size_t i = 0; i < bytes.size(); i++)
+                {
+                    sourceFile << R"(
+````````&& static_cast<unsigned char>(this->source.get()[startLocation__ + )" << i
+                               << R"(]) == 0x)" << std::hex << std::uppercase
+                               << static_cast<unsigned>(static_cast<unsigned char>(bytes[i]))
+                               << std::dec << R"(U)";
+                }
+                sourceFile << R"()
+{
+    ruleResult__ = this->makeSuccess(startLocation__ + )" << bytes.size()
+                           << R"(, startLocation__ + )" << bytes.size() << R"();
+}
+)";
+            }
+            else if(settings.utf8Input)
+            {
+                sourceFile << R"(else if(this->source.get()[startLocation__] == ')"
+                           << escapeChar(node->value) << R"(')
+{
+    ruleResult__ = this->makeSuccess(startLocation__ + 1, startLocation__ + 1);
+}
+)";
+            }
+            else
+            {
+                sourceFile << R"(else if(this->source.get()[startLocation__] == U')"
+                           << escapeChar(node->value) << R"(')
 {
     ruleResult__ = this->makeSuccess(startLocation__ + 1, startLocation__ + 1);
 }
-else
+)";
+            }
+            sourceFile << R"(else
 {
     ruleResult__ = this->makeFail(startLocation__, startLocation__ + 1, "missing )"
                        << escapeString(getCharName(node->value)) << R"(", isRequiredForSuccess__);
 }
 )";
             break;
+        case State::ReplayFunction:
+            assert(false);
+            break;
+        }
+    }
+    virtual void visitLiteral(ast::Literal *node) override
+    {
+        switch(state)
+        {
+        case State::DeclareLocals:
+            break;
+        case State::ParseAndEvaluateFunction:
+        {
+            needsIsRequiredForSuccess = true;
+            std::string literal;
+            std::vector<std::size_t> characterOffsets;
+            std::vector<std::size_t> characterIndexes;
+            bool isASCII = true;
+            if(settings.utf8Input)
+            {
+                std::size_t byteCount = 0;
+                for(std::size_t i = 0; i < node->value.size(); i++)
+                {
+                    if(node->value[i] >= 0x80)
+                        isASCII = false;
+                    characterOffsets.push_back(byteCount);
+                    byteCount += encodeUTF8(node->value[i]).size();
+                    characterIndexes.resize(byteCount, i);
+                }
+                characterOffsets.push_back(byteCount);
+            }
+            else
+            {
+                for(std::size_t i = 0; i <= node->value.size(); i++)
+                    characterOffsets.push_back(i);
+            }
+            literal = makeSourceStringLiteral(node->value);
+            std::size_t size = characterOffsets.back();
+            sourceFile << R"(if(this->sourceSize - startLocation__ >= )" << size << R"(
+```&& std::memcmp(this->source.get() + startLocation__, )" << literal << R"(, )" << size
+                       << R"( * sizeof(*this->source.get())) == 0)
+{
+    ruleResult__ = this->makeSuccess(startLocation__ + )" << size << R"(, startLocation__ + )"
+                       << size << R"();
+}
+else
+{
+    static const char *const failMessages__[] = {
+)";
+            for(char32_t ch : node->value)
+            {
+                sourceFile << R"(        "missing )" << escapeString(getCharName(ch)) << R"(",
+)";
+            }
+            sourceFile << R"(    };
+)";
+            if(!isASCII)
+            {
+                sourceFile << R"(    static const std::size_t characterIndexes__[] = {)";
+                auto seperator = "";
+                for(std::size_t index : characterIndexes)
+                {
+                    sourceFile << seperator << index;
+                    seperator = ", ";
+                }
+                sourceFile << R"(};
+    static const std::size_t characterOffsets__[] = {)";
+                seperator = "";
+                for(std::size_t offset : characterOffsets)
+                {
+                    sourceFile << seperator << offset;
+                    seperator = ", ";
+                }
+                sourceFile << R"(};
+)";
+            }
+            sourceFile << R"(    std::size_t offset__ = 0;
+    while(startLocation__ + offset__ < this->sourceSize
+    ``````&& this->source.get()[startLocation__ + offset__] == )" << literal << R"([offset__])
+        offset__++;
+)";
+            if(isASCII)
+            {
+                sourceFile << R"(    std::size_t index__ = offset__;
+)";
+            }
+            else
+            {
+                sourceFile << R"(    std::size_t index__ = characterIndexes__[offset__];
+    offset__ = characterOffsets__[index__];
+)";
+            }
+            sourceFile << R"(    if(startLocation__ + offset__ >= this->sourceSize)
+        ruleResult__ = this->makeFail(startLocation__ + offset__, failMessages__[index__], isRequiredForSuccess__);
+    else
+        ruleResult__ = this->makeFail(startLocation__ + offset__, startLocation__ + offset__ + 1, failMessages__[index__], isRequiredForSuccess__);
+}
+)";
+            break;
+        }
+        case State::ReplayFunction:
+            assert(false);
+            break;
         }
     }
     virtual void visitCharacterClass(ast::CharacterClass *node) override
@@ -1335,6 +5050,7 @@ else
             break;
         case State::ParseAndEvaluateFunction:
         {
+            bool storesCharacter = !node->variableName.empty() && !isDeferred(nonterminal);
             needsIsRequiredForSuccess = true;
             sourceFile << R"(if(startLocation__ >= this->sourceSize)
 {
@@ -1342,35 +5058,38 @@ else
 }
 else
 {
-    bool matches = false;
 )";
-            auto elseString = "";
-            for(const auto &range : node->characterRanges.ranges)
+            std::string nextLocation = "startLocation__ + 1";
+            if(settings.utf8Input)
             {
-                if(range.min == range.max)
+                nextLocation = "nextLocation__";
+                bool isASCII = node->characterRanges.ranges.empty()
+                               || node->characterRanges.ranges.back().max < 0x80;
+                if(isASCII && !node->inverted)
                 {
-                    sourceFile << R"(    )" << elseString
-                               << R"(if(this->source.get()[startLocation__] == U')"
-                               << escapeChar(range.min) << R"(')
-    {
-        matches = true;
-    }
+                    sourceFile << R"(    std::size_t nextLocation__ = startLocation__ + 1;
+    char32_t character__ = static_cast<unsigned char>(this->source.get()[startLocation__]);
+)";
+                }
+                else if(node->characterRanges.ranges.empty() && !storesCharacter)
+                {
+                    sourceFile << R"(    std::size_t nextLocation__ = startLocation__;
+    this->decodeUTF8(this->source.get(), this->sourceSize, nextLocation__);
 )";
                 }
                 else
                 {
-                    sourceFile << R"(    )" << elseString
-                               << R"(if(this->source.get()[startLocation__] >= U')"
-                               << escapeChar(range.min)
-                               << R"(' && this->source.get()[startLocation__] <= U')"
-                               << escapeChar(range.max) << R"(')
-    {
-        matches = true;
-    }
+                    sourceFile << R"(    std::size_t nextLocation__ = startLocation__;
+    char32_t character__ = this->decodeUTF8(this->source.get(), this->sourceSize, nextLocation__);
 )";
                 }
-                elseString = "else ";
             }
+            else if(!node->characterRanges.ranges.empty() || storesCharacter)
+            {
+                sourceFile << R"(    char32_t character__ = this->source.get()[startLocation__];
+)";
+            }
+            writeCharacterClassMatch(node->characterRanges);
             if(node->inverted)
             {
                 sourceFile << R"(    if(!matches))";
@@ -1381,24 +5100,38 @@ else
             }
             sourceFile << R"(
     {
-        ruleResult__ = this->makeSuccess(startLocation__ + 1, startLocation__ + 1);
+        ruleResult__ = this->makeSuccess()" << nextLocation << R"(, )" << nextLocation
+                       << R"();
 )";
-            if(state == State::ParseAndEvaluateFunction && !node->variableName.empty())
+            if(storesCharacter)
             {
-                sourceFile << R"(        )" << node->variableName
-                           << R"( = this->source.get()[startLocation__];
+                sourceFile << R"(        )" << node->variableName << R"( = character__;
 )";
             }
             sourceFile << R"(    }
     else
     {
-        ruleResult__ = this->makeFail(startLocation__, startLocation__ + 1, ")"
+        ruleResult__ = this->makeFail(startLocation__, )" << nextLocation << R"(, ")"
                        << escapeString(matchFailMessage) << R"(", isRequiredForSuccess__);
     }
 }
 )";
             break;
         }
+        case State::ReplayFunction:
+            if(settings.utf8Input)
+            {
+                sourceFile << R"(location__ = startLocation__;
+)" << node->variableName << R"( = this->decodeUTF8(this->source.get(), this->sourceSize, location__);
+)";
+            }
+            else
+            {
+                sourceFile << node->variableName << R"( = this->source.get()[startLocation__];
+location__ = startLocation__ + 1;
+)";
+            }
+            break;
         }
     }
     virtual void visitEOFTerminal(ast::EOFTerminal *node) override
@@ -1419,6 +5152,9 @@ else
 }
 )";
             break;
+        case State::ReplayFunction:
+            assert(false);
+            break;
         }
     }
     virtual void visitExpressionCodeSnippet(ast::ExpressionCodeSnippet *node) override
@@ -1428,35 +5164,47 @@ else
         case State::DeclareLocals:
             break;
         case State::ParseAndEvaluateFunction:
-        {
-            std::string code = node->code;
-            for(auto iter = node->substitutions.rbegin(); iter != node->substitutions.rend();
-                ++iter)
-            {
-                auto substitution = *iter;
-                switch(substitution.kind)
-                {
-                case ast::ExpressionCodeSnippet::Substitution::Kind::ReturnValue:
-                    code.insert(substitution.position, "(returnValue__)");
-                    continue;
-                case ast::ExpressionCodeSnippet::Substitution::Kind::PredicateReturnValue:
-                    code.insert(substitution.position, "(predicateReturnValue__)");
-                    continue;
-                case ast::ExpressionCodeSnippet::Substitution::Kind::Location:
-                    code.insert(substitution.position, "(static_cast<const ::std::size_t &>(startLocation__))");
-                    continue;
-                }
-                assert(false);
-            }
-            sourceFile << R"({
+            // deferred rules run their code when they're replayed
+            if(!isDeferred(nonterminal))
+                writeExpressionCode(node);
+            sourceFile << R"(ruleResult__ = this->makeSuccess(startLocation__);
 )";
-            writeCode(sourceFile, std::move(code), node->location);
-            sourceFile << R"(}
-ruleResult__ = this->makeSuccess(startLocation__);
+            break;
+        case State::ReplayFunction:
+            writeExpressionCode(node);
+            sourceFile << R"(location__ = startLocation__;
 )";
             break;
         }
+    }
+    void writeExpressionCode(ast::ExpressionCodeSnippet *node)
+    {
+        std::string code = node->code;
+        for(auto iter = node->substitutions.rbegin(); iter != node->substitutions.rend(); ++iter)
+        {
+            auto substitution = *iter;
+            switch(substitution.kind)
+            {
+            case ast::ExpressionCodeSnippet::Substitution::Kind::ReturnValue:
+                code.insert(substitution.position, "(returnValue__)");
+                continue;
+            case ast::ExpressionCodeSnippet::Substitution::Kind::PredicateReturnValue:
+                code.insert(substitution.position, "(predicateReturnValue__)");
+                continue;
+            case ast::ExpressionCodeSnippet::Substitution::Kind::Location:
+                code.insert(substitution.position, "(static_cast<const ::std::size_t &>(startLocation__))");
+                continue;
+            case ast::ExpressionCodeSnippet::Substitution::Kind::Move:
+                code.insert(substitution.position, "::std::move");
+                continue;
+            }
+            assert(false);
         }
+        sourceFile << R"({
+)";
+        writeCode(sourceFile, std::move(code), node->location);
+        sourceFile << R"(}
+)";
     }
     virtual void visitTopLevelCodeSnippet(ast::TopLevelCodeSnippet *node) override
     {
@@ -1487,11 +5235,284 @@ std::unique_ptr<CodeGenerator> CodeGenerator::makeCPlusPlus11(
     std::ostream &headerFile,
     std::string headerFileName,
     std::string headerFileNameFromSourceFile,
-    std::string sourceFileName)
+    std::string sourceFileName,
+    CPlusPlus11Settings settings)
 {
     return std::unique_ptr<CodeGenerator>(new CPlusPlus11(sourceFile,
                                                           headerFile,
                                                           std::move(headerFileName),
                                                           std::move(headerFileNameFromSourceFile),
-                                                          std::move(sourceFileName)));
+                                                          std::move(sourceFileName),
+                                                          std::move(settings)));
+}
+
+struct CodeGenerator::Bytecode final : public CodeGenerator, public ast::Visitor
+{
+    ErrorHandler &errorHandler;
+    bytecode::Program &program;
+    std::map<const ast::Nonterminal *, bytecode::Word> ruleIndexes;
+    std::map<std::string, bytecode::Word> stringOffsets;
+    Bytecode(ErrorHandler &errorHandler, bytecode::Program &program)
+        : errorHandler(errorHandler), program(program)
+    {
+    }
+    bytecode::Word addString(const std::string &str)
+    {
+        auto iter = stringOffsets.find(str);
+        if(iter != stringOffsets.end())
+            return std::get<1>(*iter);
+        auto offset = static_cast<bytecode::Word>(program.strings.size());
+        program.strings.insert(program.strings.end(), str.begin(), str.end());
+        program.strings.push_back('\0');
+        stringOffsets.emplace(str, offset);
+        return offset;
+    }
+    std::size_t beginInstruction()
+    {
+        std::size_t start = program.code.size();
+        program.code.push_back(0);
+        return start;
+    }
+    void endInstruction(ast::Node *node, std::size_t start, bytecode::Opcode opcode)
+    {
+        std::size_t length = program.code.size() - start;
+        if(length > bytecode::maximumInstructionLength)
+            errorHandler(ErrorLevel::FatalError, node->location, "expression is too big");
+        program.code[start] = bytecode::makeInstructionHeader(opcode, length);
+    }
+    void writeInstruction(ast::Node *node, bytecode::Opcode opcode)
+    {
+        endInstruction(node, beginInstruction(), opcode);
+    }
+    void writeNested(ast::Node *node, bytecode::Opcode opcode, ast::Expression *expression)
+    {
+        std::size_t start = beginInstruction();
+        expression->visit(*this);
+        endInstruction(node, start, opcode);
+    }
+    virtual void generateCode(const ast::Grammar *grammar) override
+    {
+        program = bytecode::Program();
+        for(const ast::Nonterminal *nonterminal : grammar->nonterminals)
+        {
+            ruleIndexes.emplace(nonterminal, static_cast<bytecode::Word>(program.rules.size()));
+            bytecode::Rule rule;
+            rule.name = addString(nonterminal->name);
+            rule.code = 0;
+            rule.memoSlot = bytecode::noMemoSlot;
+            if(nonterminal->settings.caching)
+                rule.memoSlot = program.memoSlotCount++;
+            rule.memoizeValue = nonterminal->settings.memoizeValue;
+            program.rules.push_back(rule);
+        }
+        for(std::size_t i = 0; i < grammar->nonterminals.size(); i++)
+        {
+            program.rules[i].code = static_cast<bytecode::Word>(program.code.size());
+            grammar->nonterminals[i]->expression->visit(*this);
+        }
+    }
+    virtual void visitEmpty(ast::Empty *node) override
+    {
+        writeInstruction(node, bytecode::Opcode::Empty);
+    }
+    virtual void visitCut(ast::Cut *node) override
+    {
+        writeInstruction(node, bytecode::Opcode::Cut);
+    }
+    virtual void visitGrammar(ast::Grammar *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminal(ast::Nonterminal *node) override
+    {
+        assert(false);
+    }
+    virtual void visitNonterminalExpression(ast::NonterminalExpression *node) override
+    {
+        // template arguments only matter to code, which the interpreter doesn't run
+        std::size_t start = beginInstruction();
+        program.code.push_back(ruleIndexes.at(node->value));
+        endInstruction(node, start, bytecode::Opcode::Call);
+    }
+    virtual void visitOrderedChoice(ast::OrderedChoice *node) override
+    {
+        std::vector<ast::Expression *> alternatives;
+        ast::Expression *expression = node;
+        while(auto orderedChoice = dynamic_cast<ast::OrderedChoice *>(expression))
+        {
+            alternatives.push_back(orderedChoice->second);
+            expression = orderedChoice->first;
+        }
+        alternatives.push_back(expression);
+        std::reverse(alternatives.begin(), alternatives.end());
+        std::size_t dispatchedAlternativeCount =
+            std::min(alternatives.size(), bytecode::maximumDispatchedAlternativeCount);
+        std::size_t firstSetsStart = program.firstSets.size();
+        program.firstSets.resize(firstSetsStart + bytecode::firstSetSize
+                                     + dispatchedAlternativeCount * bytecode::alternativeFirstSetSize,
+                                 0);
+        for(std::size_t i = 0; i < dispatchedAlternativeCount; i++)
+        {
+            std::size_t firstSetStart =
+                firstSetsStart + bytecode::firstSetSize + i * bytecode::alternativeFirstSetSize;
+            auto skippedFailure = CPlusPlus11::getSkippedFailure(alternatives[i]);
+            if(!skippedFailure.canSkip)
+            {
+                for(std::size_t j = 0; j < bytecode::firstSetSize - 1; j++)
+                    program.firstSets[firstSetStart + j] = ~static_cast<bytecode::Word>(0);
+                program.firstSets[firstSetStart + bytecode::firstSetSize - 1] =
+                    bytecode::FirstSetFlags::hasNonASCII | bytecode::FirstSetFlags::hasNonLatin1;
+            }
+            else
+            {
+                ast::FirstSet firstSet = alternatives[i]->getFirstSet();
+                bytecode::Word flags = 0;
+                if(firstSet.overlaps(0x80, ast::FirstSet::maxCharacter()))
+                    flags |= bytecode::FirstSetFlags::hasNonASCII;
+                if(firstSet.overlaps(0x100, ast::FirstSet::maxCharacter()))
+                    flags |= bytecode::FirstSetFlags::hasNonLatin1;
+                program.firstSets[firstSetStart + bytecode::firstSetSize - 1] = flags;
+                for(const auto &range : firstSet.ranges)
+                {
+                    for(char32_t ch = range.min; ch <= range.max && ch < 0x100; ch++)
+                        program.firstSets[firstSetStart + ch / 32] |=
+                            static_cast<bytecode::Word>(1) << ch % 32;
+                }
+                program.firstSets[firstSetStart + bytecode::firstSetSize] =
+                    addString(skippedFailure.message);
+                program.firstSets[firstSetStart + bytecode::firstSetSize + 1] =
+                    static_cast<bytecode::Word>(skippedFailure.endOffset);
+            }
+            for(std::size_t j = 0; j < bytecode::firstSetSize; j++)
+                program.firstSets[firstSetsStart + j] |= program.firstSets[firstSetStart + j];
+        }
+        std::size_t start = beginInstruction();
+        program.code.push_back(static_cast<bytecode::Word>(firstSetsStart));
+        for(ast::Expression *alternative : alternatives)
+            alternative->visit(*this);
+        endInstruction(node, start, bytecode::Opcode::Choice);
+    }
+    virtual void visitFollowedByPredicate(ast::FollowedByPredicate *node) override
+    {
+        writeNested(node, bytecode::Opcode::FollowedBy, node->expression);
+    }
+    virtual void visitNotFollowedByPredicate(ast::NotFollowedByPredicate *node) override
+    {
+        writeNested(node, bytecode::Opcode::NotFollowedBy, node->expression);
+    }
+    virtual void visitCustomPredicate(ast::CustomPredicate *node) override
+    {
+        errorHandler(ErrorLevel::Warning,
+                     node->location,
+                     "custom predicates aren't run by the bytecode interpreter; assuming success");
+        writeInstruction(node, bytecode::Opcode::CustomPredicate);
+    }
+    virtual void visitGreedyRepetition(ast::GreedyRepetition *node) override
+    {
+        writeNested(node, bytecode::Opcode::Repetition, node->expression);
+    }
+    virtual void visitGreedyPositiveRepetition(ast::GreedyPositiveRepetition *node) override
+    {
+        writeNested(node, bytecode::Opcode::PositiveRepetition, node->expression);
+    }
+    virtual void visitOptionalExpression(ast::OptionalExpression *node) override
+    {
+        writeNested(node, bytecode::Opcode::Optional, node->expression);
+    }
+    virtual void visitSequence(ast::Sequence *node) override
+    {
+        std::vector<ast::Expression *> elements;
+        ast::Expression *expression = node;
+        while(auto sequence = dynamic_cast<ast::Sequence *>(expression))
+        {
+            elements.push_back(sequence->second);
+            expression = sequence->first;
+        }
+        elements.push_back(expression);
+        std::size_t start = beginInstruction();
+        for(auto iter = elements.rbegin(); iter != elements.rend(); ++iter)
+            (*iter)->visit(*this);
+        endInstruction(node, start, bytecode::Opcode::Sequence);
+    }
+    virtual void visitTerminal(ast::Terminal *node) override
+    {
+        std::size_t start = beginInstruction();
+        program.code.push_back(node->value);
+        program.code.push_back(addString("missing " + CPlusPlus11::getCharName(node->value)));
+        endInstruction(node, start, bytecode::Opcode::Terminal);
+    }
+    virtual void visitLiteral(ast::Literal *node) override
+    {
+        std::size_t start = beginInstruction();
+        program.code.push_back(static_cast<bytecode::Word>(program.characters.size()));
+        program.code.push_back(static_cast<bytecode::Word>(node->value.size()));
+        for(char32_t ch : node->value)
+        {
+            program.characters.push_back(ch);
+            program.code.push_back(addString("missing " + CPlusPlus11::getCharName(ch)));
+        }
+        endInstruction(node, start, bytecode::Opcode::Literal);
+    }
+    virtual void visitCharacterClass(ast::CharacterClass *node) override
+    {
+        const auto &ranges = node->characterRanges.ranges;
+        bytecode::Word flags = 0;
+        if(node->inverted)
+            flags |= bytecode::CharacterClassFlags::inverted;
+        if(ranges.empty() || ranges.back().max < 0x80)
+            flags |= bytecode::CharacterClassFlags::ascii;
+        std::size_t start = beginInstruction();
+        program.code.push_back(flags);
+        program.code.push_back(static_cast<bytecode::Word>(program.characters.size()));
+        program.code.push_back(static_cast<bytecode::Word>(ranges.size()));
+        program.code.push_back(static_cast<bytecode::Word>(program.bitmaps.size()));
+        program.code.push_back(
+            addString(CPlusPlus11::getCharacterClassMatchFailMessage(node)));
+        std::size_t bitmapStart = program.bitmaps.size();
+        program.bitmaps.resize(bitmapStart + 8, 0);
+        for(const auto &range : ranges)
+        {
+            program.characters.push_back(range.min);
+            program.characters.push_back(range.max);
+            for(char32_t ch = range.min; ch <= range.max && ch < 0x100; ch++)
+                program.bitmaps[bitmapStart + ch / 32] |= static_cast<bytecode::Word>(1) << ch % 32;
+        }
+        endInstruction(node, start, bytecode::Opcode::CharacterClass);
+    }
+    virtual void visitEOFTerminal(ast::EOFTerminal *node) override
+    {
+        writeInstruction(node, bytecode::Opcode::EndOfFile);
+    }
+    virtual void visitExpressionCodeSnippet(ast::ExpressionCodeSnippet *node) override
+    {
+        writeInstruction(node, bytecode::Opcode::Empty);
+    }
+    virtual void visitTopLevelCodeSnippet(ast::TopLevelCodeSnippet *node) override
+    {
+    }
+    virtual void visitType(ast::Type *node) override
+    {
+    }
+    virtual void visitTemplateArgumentType(ast::TemplateArgumentType *node) override
+    {
+    }
+    virtual void visitTemplateArgumentTypeValue(ast::TemplateArgumentTypeValue *node) override
+    {
+    }
+    virtual void visitTemplateArgumentConstant(ast::TemplateArgumentConstant *node) override
+    {
+    }
+    virtual void visitTemplateVariableDeclaration(ast::TemplateVariableDeclaration *node) override
+    {
+    }
+    virtual void visitTemplateArgumentVariableReference(
+        ast::TemplateArgumentVariableReference *node) override
+    {
+    }
+};
+
+std::unique_ptr<CodeGenerator> CodeGenerator::makeBytecode(ErrorHandler &errorHandler,
+                                                           bytecode::Program &program)
+{
+    return std::unique_ptr<CodeGenerator>(new Bytecode(errorHandler, program));
 }
@@ -27,18 +27,51 @@
 #include <memory>
 #include <iosfwd>
 
+struct ErrorHandler;
+
+namespace bytecode
+{
+struct Program;
+}
+
 struct CodeGenerator
 {
     virtual ~CodeGenerator() = default;
     virtual void generateCode(const ast::Grammar *grammar) = 0;
-    static std::unique_ptr<CodeGenerator> makeCPlusPlus11(std::ostream &sourceFile,
-                                                          std::ostream &headerFile,
-                                                          std::string headerFileName,
-                                                          std::string headerFileNameFromSourceFile,
-                                                          std::string sourceFileName);
+    struct CPlusPlus11Settings final
+    {
+        enum class MemoTable
+        {
+            Dense,
+            Hashed,
+            Windowed,
+        };
+        bool utf8Input = false;
+        MemoTable memoTable = MemoTable::Dense;
+        std::size_t memoWindowSize = 0x1000;
+        bool compactMemo = false;
+        bool memoProfile = false;
+        bool ruleProfile = false;
+        bool ruleProfileCycles = false;
+        bool deferActions = false;
+        bool valueArena = false;
+        std::size_t inlineSizeLimit = 8;
+    };
+    static std::unique_ptr<CodeGenerator> makeCPlusPlus11(
+        std::ostream &sourceFile,
+        std::ostream &headerFile,
+        std::string headerFileName,
+        std::string headerFileNameFromSourceFile,
+        std::string sourceFileName,
+        CPlusPlus11Settings settings);
+    // compiles the grammar for bytecode::BasicInterpreter; code snippets aren't compiled, so the
+    // interpreter only recognizes input
+    static std::unique_ptr<CodeGenerator> makeBytecode(ErrorHandler &errorHandler,
+                                                       bytecode::Program &program);
 
 private:
     struct CPlusPlus11;
+    struct Bytecode;
 };
 
 #endif /* CODE_GENERATOR_H_ */
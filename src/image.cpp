@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "image.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IMAGE_USE_MMAP
+#endif
+
+namespace bytecode
+{
+namespace
+{
+const char imageMagic[8] = {'P', 'E', 'G', 'I', 'M', 'A', 'G', 'E'};
+
+static_assert(sizeof(Rule) == 4 * sizeof(Word), "Rule must not have padding");
+static_assert(sizeof(char32_t) == sizeof(Word), "char32_t must be 32 bits");
+static_assert(sizeof(ImageHeader) % sizeof(Word) == 0, "ImageHeader must keep tables aligned");
+
+struct ImageWriter final
+{
+    std::vector<char> image;
+    std::uint32_t append(const void *data, std::size_t count, std::size_t elementSize)
+    {
+        std::size_t offset = image.size();
+        std::size_t size = count * elementSize;
+        if(size > 0xFFFFFFFFUL - offset)
+            throw ImageError("program is too big for an image");
+        image.resize(offset + (size + sizeof(Word) - 1) / sizeof(Word) * sizeof(Word), '\0');
+        if(size != 0)
+            std::memcpy(image.data() + offset, data, size);
+        return static_cast<std::uint32_t>(offset);
+    }
+    template <typename T>
+    void appendTable(const std::vector<T> &table, std::uint32_t &offset, std::uint32_t &count)
+    {
+        offset = append(table.data(), table.size(), sizeof(T));
+        count = static_cast<std::uint32_t>(table.size());
+    }
+};
+
+template <typename T>
+const T *getTable(const char *image,
+                  const ImageHeader &header,
+                  std::uint32_t offset,
+                  std::uint32_t count)
+{
+    if(offset % alignof(T) != 0 || offset < header.headerSize || offset > header.imageSize
+       || count > (header.imageSize - offset) / sizeof(T))
+        throw ImageError("image table is out of bounds");
+    return reinterpret_cast<const T *>(image + offset);
+}
+}
+
+void writeImage(std::ostream &os, const Program &program)
+{
+    ImageWriter writer;
+    ImageHeader header{};
+    writer.image.resize(sizeof(ImageHeader));
+    writer.appendTable(program.code, header.codeOffset, header.codeSize);
+    writer.appendTable(program.rules, header.rulesOffset, header.ruleCount);
+    writer.appendTable(program.characters, header.charactersOffset, header.characterCount);
+    writer.appendTable(program.bitmaps, header.bitmapsOffset, header.bitmapsSize);
+    writer.appendTable(program.firstSets, header.firstSetsOffset, header.firstSetsSize);
+    writer.appendTable(program.strings, header.stringsOffset, header.stringsSize);
+    std::memcpy(header.magic, imageMagic, sizeof(imageMagic));
+    header.version = imageVersion;
+    header.byteOrderMark = imageByteOrderMark;
+    header.headerSize = sizeof(ImageHeader);
+    header.imageSize = static_cast<std::uint32_t>(writer.image.size());
+    header.memoSlotCount = program.memoSlotCount;
+    std::memcpy(writer.image.data(), &header, sizeof(ImageHeader));
+    os.write(writer.image.data(), writer.image.size());
+}
+
+ProgramView loadImage(const void *data, std::size_t size)
+{
+    if(reinterpret_cast<std::uintptr_t>(data) % alignof(ImageHeader) != 0)
+        throw ImageError("image isn't aligned");
+    if(size < sizeof(ImageHeader))
+        throw ImageError("not a grammar image");
+    const char *image = static_cast<const char *>(data);
+    const ImageHeader &header = *static_cast<const ImageHeader *>(data);
+    if(std::memcmp(header.magic, imageMagic, sizeof(imageMagic)) != 0)
+        throw ImageError("not a grammar image");
+    if(header.byteOrderMark != imageByteOrderMark)
+        throw ImageError("image was written with a different byte order");
+    if(header.version != imageVersion || header.headerSize != sizeof(ImageHeader))
+        throw ImageError("image was written by an incompatible version");
+    if(header.imageSize > size)
+        throw ImageError("image is truncated");
+    ProgramView retval;
+    retval.code = getTable<Word>(image, header, header.codeOffset, header.codeSize);
+    retval.codeSize = header.codeSize;
+    retval.rules = getTable<Rule>(image, header, header.rulesOffset, header.ruleCount);
+    retval.ruleCount = header.ruleCount;
+    retval.characters =
+        getTable<char32_t>(image, header, header.charactersOffset, header.characterCount);
+    retval.characterCount = header.characterCount;
+    retval.bitmaps = getTable<Word>(image, header, header.bitmapsOffset, header.bitmapsSize);
+    retval.bitmapsSize = header.bitmapsSize;
+    retval.firstSets =
+        getTable<Word>(image, header, header.firstSetsOffset, header.firstSetsSize);
+    retval.firstSetsSize = header.firstSetsSize;
+    retval.strings = getTable<char>(image, header, header.stringsOffset, header.stringsSize);
+    retval.stringsSize = header.stringsSize;
+    if(retval.stringsSize != 0 && retval.strings[retval.stringsSize - 1] != '\0')
+        throw ImageError("image strings aren't terminated");
+    retval.memoSlotCount = header.memoSlotCount;
+    return retval;
+}
+
+MappedImage::MappedImage(const std::string &fileName)
+{
+#ifdef IMAGE_USE_MMAP
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw ImageError("can't open image: '" + fileName + "': " + std::strerror(errno));
+    struct stat status;
+    if(::fstat(fd, &status) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw ImageError("can't read image: '" + fileName + "': " + std::strerror(error));
+    }
+    size = static_cast<std::size_t>(status.st_size);
+    if(size == 0)
+    {
+        ::close(fd);
+        throw ImageError("not a grammar image: '" + fileName + "'");
+    }
+    data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED)
+    {
+        data = nullptr;
+        throw ImageError("can't map image: '" + fileName + "': " + std::strerror(errno));
+    }
+#else
+    std::ifstream is(fileName, std::ios::binary | std::ios::ate);
+    if(!is)
+        throw ImageError("can't open image: '" + fileName + "'");
+    size = static_cast<std::size_t>(is.tellg());
+    data = new Word[(size + sizeof(Word) - 1) / sizeof(Word)];
+    is.seekg(0);
+    if(!is.read(static_cast<char *>(data), size))
+    {
+        delete[] static_cast<Word *>(data);
+        throw ImageError("can't read image: '" + fileName + "'");
+    }
+#endif
+    try
+    {
+        program = loadImage(data, size);
+    }
+    catch(...)
+    {
+        release();
+        throw;
+    }
+}
+
+MappedImage::~MappedImage()
+{
+    release();
+}
+
+void MappedImage::release() noexcept
+{
+    if(!data)
+        return;
+#ifdef IMAGE_USE_MMAP
+    ::munmap(data, size);
+#else
+    delete[] static_cast<Word *>(data);
+#endif
+    data = nullptr;
+}
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include "bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <stdexcept>
+#include <string>
+
+// a precompiled grammar image is a Program laid out so it can be used straight from a mapped
+// file: a fixed-size header followed by the tables, each aligned to 4 bytes, in native byte
+// order
+namespace bytecode
+{
+constexpr std::uint32_t imageVersion = 2;
+constexpr std::uint32_t imageByteOrderMark = 0x01020304UL;
+
+struct ImageHeader final
+{
+    char magic[8]; // "PEGIMAGE"
+    std::uint32_t version;
+    std::uint32_t byteOrderMark;
+    std::uint32_t headerSize;
+    std::uint32_t imageSize;
+    std::uint32_t memoSlotCount;
+    // byte offsets from the start of the image and element counts
+    std::uint32_t codeOffset, codeSize;
+    std::uint32_t rulesOffset, ruleCount;
+    std::uint32_t charactersOffset, characterCount;
+    std::uint32_t bitmapsOffset, bitmapsSize;
+    std::uint32_t firstSetsOffset, firstSetsSize;
+    std::uint32_t stringsOffset, stringsSize;
+};
+
+struct ImageError final : public std::runtime_error
+{
+    explicit ImageError(const std::string &message) : std::runtime_error(message)
+    {
+    }
+};
+
+// throws ImageError if the program is too big for an image
+void writeImage(std::ostream &os, const Program &program);
+
+// checks the header and table bounds only; the rest of the image is trusted. data must be
+// aligned to 4 bytes and outlive the returned view. throws ImageError if the image is invalid
+// or was written by an incompatible version
+ProgramView loadImage(const void *data, std::size_t size);
+
+// maps an image file read-only, falling back to reading it where mmap isn't available
+class MappedImage final
+{
+    MappedImage(const MappedImage &) = delete;
+    MappedImage &operator=(const MappedImage &) = delete;
+
+private:
+    void *data = nullptr;
+    std::size_t size = 0;
+    ProgramView program;
+    void release() noexcept;
+
+public:
+    // throws ImageError if the file can't be read or isn't a valid image
+    explicit MappedImage(const std::string &fileName);
+    ~MappedImage();
+    const ProgramView &getProgram() const noexcept
+    {
+        return program;
+    }
+};
+}
+
+#endif /* IMAGE_H_ */
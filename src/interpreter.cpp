@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "interpreter.h"
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace bytecode
+{
+namespace
+{
+const char *const unexpectedEndOfInputMessage = "unexpected end of input";
+const char *const notAllowedHereMessage = "not allowed here";
+const char *const expectedEndOfFileMessage = "expected end of file";
+
+// UTF-8 input: locations are byte offsets, like in parsers generated with --utf8
+char32_t decodeUTF8(const char *source, std::size_t sourceSize, std::size_t &position)
+{
+    const char32_t replacementChar = U'\uFFFD';
+    unsigned long byte1 = static_cast<unsigned char>(source[position++]);
+    if(byte1 < 0x80)
+        return static_cast<char32_t>(byte1);
+    if(position >= sourceSize || byte1 < 0xC0 || (source[position] & 0xC0) != 0x80)
+        return replacementChar;
+    bool invalid = byte1 < 0xC2 || byte1 > 0xF4;
+    unsigned long byte2 = static_cast<unsigned char>(source[position++]);
+    if(byte1 < 0xE0)
+    {
+        if(invalid)
+            return replacementChar;
+        return static_cast<char32_t>(((byte1 & 0x1F) << 6) | (byte2 & 0x3F));
+    }
+    if(position >= sourceSize || (source[position] & 0xC0) != 0x80)
+        return replacementChar;
+    unsigned long byte3 = static_cast<unsigned char>(source[position++]);
+    if(byte1 < 0xF0)
+    {
+        if(byte1 == 0xE0 && byte2 < 0xA0)
+            invalid = true;
+        if(invalid)
+            return replacementChar;
+        return static_cast<char32_t>(((byte1 & 0xF) << 12) | ((byte2 & 0x3F) << 6)
+                                     | (byte3 & 0x3F));
+    }
+    if(position >= sourceSize || (source[position] & 0xC0) != 0x80)
+        return replacementChar;
+    unsigned long byte4 = static_cast<unsigned char>(source[position++]);
+    if(byte1 == 0xF0 && byte2 < 0x90)
+        invalid = true;
+    if(byte1 == 0xF4 && byte2 > 0x8F)
+        invalid = true;
+    if(invalid)
+        return replacementChar;
+    return static_cast<char32_t>(((byte1 & 0x7) << 18) | ((byte2 & 0x3F) << 12)
+                                 | ((byte3 & 0x3F) << 6) | (byte4 & 0x3F));
+}
+
+std::size_t encodeUTF8(char32_t ch, unsigned char *bytes)
+{
+    if(ch < 0x80)
+    {
+        bytes[0] = static_cast<unsigned char>(ch);
+        return 1;
+    }
+    if(ch < 0x800)
+    {
+        bytes[0] = static_cast<unsigned char>(0xC0 | (ch >> 6));
+        bytes[1] = static_cast<unsigned char>(0x80 | (ch & 0x3F));
+        return 2;
+    }
+    if(ch < 0x10000)
+    {
+        bytes[0] = static_cast<unsigned char>(0xE0 | (ch >> 12));
+        bytes[1] = static_cast<unsigned char>(0x80 | ((ch >> 6) & 0x3F));
+        bytes[2] = static_cast<unsigned char>(0x80 | (ch & 0x3F));
+        return 3;
+    }
+    bytes[0] = static_cast<unsigned char>(0xF0 | (ch >> 18));
+    bytes[1] = static_cast<unsigned char>(0x80 | ((ch >> 12) & 0x3F));
+    bytes[2] = static_cast<unsigned char>(0x80 | ((ch >> 6) & 0x3F));
+    bytes[3] = static_cast<unsigned char>(0x80 | (ch & 0x3F));
+    return 4;
+}
+
+// returns the number of input elements matched by ch at position, or 0
+std::size_t matchCharacter(const char *source,
+                           std::size_t sourceSize,
+                           std::size_t position,
+                           char32_t ch)
+{
+    unsigned char bytes[4];
+    std::size_t byteCount = encodeUTF8(ch, bytes);
+    if(sourceSize - position < byteCount)
+        return 0;
+    for(std::size_t i = 0; i < byteCount; i++)
+        if(static_cast<unsigned char>(source[position + i]) != bytes[i])
+            return 0;
+    return byteCount;
+}
+
+std::size_t matchCharacter(const char32_t *source,
+                           std::size_t,
+                           std::size_t position,
+                           char32_t ch)
+{
+    return source[position] == ch ? 1 : 0;
+}
+
+char32_t readCharacter(const char *source,
+                       std::size_t sourceSize,
+                       std::size_t position,
+                       bool isASCIIClass,
+                       std::size_t &nextPosition)
+{
+    if(isASCIIClass)
+    {
+        nextPosition = position + 1;
+        return static_cast<unsigned char>(source[position]);
+    }
+    nextPosition = position;
+    return decodeUTF8(source, sourceSize, nextPosition);
+}
+
+char32_t readCharacter(const char32_t *source,
+                       std::size_t,
+                       std::size_t position,
+                       bool,
+                       std::size_t &nextPosition)
+{
+    nextPosition = position + 1;
+    return source[position];
+}
+
+// generated UTF-8 parsers dispatch on the first byte when it's ASCII
+bool firstSetContains(const Word *firstSet, const char *source, std::size_t position)
+{
+    unsigned char ch = static_cast<unsigned char>(source[position]);
+    if(ch >= 0x80)
+        return firstSet[firstSetSize - 1] & FirstSetFlags::hasNonASCII;
+    return (firstSet[ch / 32] >> ch % 32) & 1;
+}
+
+bool firstSetContains(const Word *firstSet, const char32_t *source, std::size_t position)
+{
+    char32_t ch = source[position];
+    if(ch >= 0x100)
+        return firstSet[firstSetSize - 1] & FirstSetFlags::hasNonLatin1;
+    return (firstSet[ch / 32] >> ch % 32) & 1;
+}
+
+bool characterClassMatches(const ProgramView &program,
+                           const Word *operands,
+                           char32_t ch)
+{
+    if(ch < 0x100)
+    {
+        const Word *bitmap = program.bitmaps + operands[3];
+        return (bitmap[ch / 32] >> ch % 32) & 1;
+    }
+    const char32_t *ranges = program.characters + operands[1];
+    std::size_t low = 0, high = operands[2];
+    while(low < high)
+    {
+        std::size_t middle = low + (high - low) / 2;
+        if(ch < ranges[2 * middle])
+            high = middle;
+        else if(ch > ranges[2 * middle + 1])
+            low = middle + 1;
+        else
+            return true;
+    }
+    return false;
+}
+}
+
+template <typename CharType>
+BasicInterpreter<CharType>::BasicInterpreter(const ProgramView &program,
+                                             const CharType *source,
+                                             std::size_t sourceSize)
+    : program(program), source(source), sourceSize(sourceSize)
+{
+    reset(source, sourceSize);
+}
+
+template <typename CharType>
+void BasicInterpreter<CharType>::reset(const CharType *source, std::size_t sourceSize)
+{
+    this->source = source;
+    this->sourceSize = sourceSize;
+    resultsChunks.clear();
+    resultsUsed = 1;
+    resultsIndexes.assign(sourceSize, 0);
+    eofResults.reset(new MemoEntry[program.memoSlotCount]);
+    errorLocation = 0;
+    errorInputEndLocation = 0;
+    errorMessage = "no error";
+}
+
+template <typename CharType>
+typename BasicInterpreter<CharType>::MemoEntry *BasicInterpreter<CharType>::getResults(
+    std::size_t position)
+{
+    if(position >= sourceSize)
+        return eofResults.get();
+    ResultsIndex &index = resultsIndexes[position];
+    if(index == 0)
+    {
+        if(resultsUsed == static_cast<ResultsIndex>(-1))
+            throw std::length_error("too many memoized results");
+        index = resultsUsed++;
+        if(index / resultsChunkSize >= resultsChunks.size())
+            resultsChunks.emplace_back(new MemoEntry[resultsChunkSize * program.memoSlotCount]);
+    }
+    return &resultsChunks[index / resultsChunkSize][index % resultsChunkSize
+                                                    * program.memoSlotCount];
+}
+
+template <typename CharType>
+typename BasicInterpreter<CharType>::RuleResult BasicInterpreter<CharType>::parseRule(
+    std::size_t ruleIndex, std::size_t startLocation, bool isRequiredForSuccess)
+{
+    const Rule &rule = program.rules[ruleIndex];
+    const Word *code = program.code + rule.code;
+    if(rule.memoSlot == noMemoSlot)
+        return evaluate(code, startLocation, isRequiredForSuccess, nullptr);
+    MemoEntry *entry = getResults(startLocation) + rule.memoSlot;
+    if(!entry->result.empty()
+       && (entry->result.fail() || !isRequiredForSuccess || (rule.memoizeValue && entry->hasValue)))
+        return entry->result;
+    RuleResult ruleResult = evaluate(code, startLocation, isRequiredForSuccess, nullptr);
+    // evaluating can allocate another chunk, but chunks never move
+    entry = getResults(startLocation) + rule.memoSlot;
+    entry->result = ruleResult;
+    if(rule.memoizeValue && ruleResult.success() && isRequiredForSuccess)
+        entry->hasValue = true;
+    return ruleResult;
+}
+
+template <typename CharType>
+typename BasicInterpreter<CharType>::RuleResult BasicInterpreter<CharType>::evaluate(
+    const Word *instruction,
+    std::size_t startLocation,
+    bool isRequiredForSuccess,
+    bool *choiceIsActive)
+{
+    const Word *operands = instruction + 1;
+    const Word *end = instruction + getInstructionLength(*instruction);
+    switch(getOpcode(*instruction))
+    {
+    case Opcode::Empty:
+    case Opcode::CustomPredicate:
+        return makeSuccess(startLocation);
+    case Opcode::Cut:
+        if(choiceIsActive)
+            *choiceIsActive = false;
+        return makeSuccess(startLocation);
+    case Opcode::Call:
+        return parseRule(operands[0], startLocation, isRequiredForSuccess);
+    case Opcode::Choice:
+    {
+        // when no alternative can start with the next character, they're all tried so the
+        // errors are reported; a skipped alternative records the failure it would have reported
+        const Word *firstSet = program.firstSets + operands[0];
+        bool isDispatched =
+            startLocation < sourceSize && firstSetContains(firstSet, source, startLocation);
+        auto getAlternativeFirstSet = [&](std::size_t index) -> const Word *
+        {
+            return firstSet + firstSetSize + index * alternativeFirstSetSize;
+        };
+        auto canSkip = [&](std::size_t index) -> bool
+        {
+            return isDispatched && index < maximumDispatchedAlternativeCount
+                   && !firstSetContains(getAlternativeFirstSet(index), source, startLocation);
+        };
+        auto makeSkippedFailure = [&](std::size_t index) -> RuleResult
+        {
+            const Word *skippedFailure = getAlternativeFirstSet(index) + firstSetSize;
+            return makeFail(startLocation,
+                            startLocation + skippedFailure[1],
+                            program.getString(skippedFailure[0]),
+                            isRequiredForSuccess);
+        };
+        bool isActive = true;
+        const Word *alternative = operands + 1;
+        RuleResult ruleResult;
+        if(canSkip(0))
+            ruleResult = makeSkippedFailure(0);
+        else
+            ruleResult = evaluate(alternative, startLocation, isRequiredForSuccess, &isActive);
+        alternative += getInstructionLength(*alternative);
+        for(std::size_t index = 1; alternative != end;
+            index++, alternative += getInstructionLength(*alternative))
+        {
+            if(!ruleResult.fail() || !isActive)
+                break;
+            if(canSkip(index))
+            {
+                ruleResult = makeSkippedFailure(index);
+                continue;
+            }
+            RuleResult lastRuleResult = ruleResult;
+            ruleResult = evaluate(alternative, startLocation, isRequiredForSuccess, &isActive);
+            if(ruleResult.success() && lastRuleResult.endLocation >= ruleResult.endLocation)
+                ruleResult.endLocation = lastRuleResult.endLocation;
+        }
+        return ruleResult;
+    }
+    case Opcode::Sequence:
+    {
+        RuleResult ruleResult = makeSuccess(startLocation);
+        for(const Word *element = operands; element != end;
+            element += getInstructionLength(*element))
+        {
+            ruleResult =
+                evaluate(element, ruleResult.location, isRequiredForSuccess, choiceIsActive);
+            if(!ruleResult.success())
+                break;
+        }
+        return ruleResult;
+    }
+    case Opcode::Repetition:
+    case Opcode::PositiveRepetition:
+    {
+        RuleResult savedRuleResult = makeSuccess(startLocation);
+        if(getOpcode(*instruction) == Opcode::PositiveRepetition)
+        {
+            savedRuleResult = evaluate(operands, startLocation, isRequiredForSuccess, choiceIsActive);
+            if(!savedRuleResult.success())
+                return savedRuleResult;
+        }
+        while(true)
+        {
+            RuleResult ruleResult = evaluate(
+                operands, savedRuleResult.location, isRequiredForSuccess, choiceIsActive);
+            if(ruleResult.fail() || ruleResult.location == savedRuleResult.location)
+                return makeSuccess(savedRuleResult.location, ruleResult.endLocation);
+            savedRuleResult = makeSuccess(ruleResult.location, ruleResult.endLocation);
+        }
+    }
+    case Opcode::Optional:
+    {
+        RuleResult ruleResult =
+            evaluate(operands, startLocation, isRequiredForSuccess, choiceIsActive);
+        if(ruleResult.fail())
+            return makeSuccess(startLocation);
+        return ruleResult;
+    }
+    case Opcode::FollowedBy:
+    {
+        RuleResult ruleResult = evaluate(operands, startLocation, isRequiredForSuccess, nullptr);
+        if(ruleResult.success())
+            ruleResult.location = startLocation;
+        return ruleResult;
+    }
+    case Opcode::NotFollowedBy:
+    {
+        RuleResult ruleResult =
+            evaluate(operands, startLocation, !isRequiredForSuccess, nullptr);
+        if(ruleResult.success())
+            return makeFail(startLocation, notAllowedHereMessage, isRequiredForSuccess);
+        return makeSuccess(startLocation);
+    }
+    case Opcode::Terminal:
+    {
+        const char *message = program.getString(operands[1]);
+        if(startLocation >= sourceSize)
+            return makeFail(startLocation, message, isRequiredForSuccess);
+        std::size_t size = matchCharacter(source, sourceSize, startLocation, operands[0]);
+        if(size != 0)
+            return makeSuccess(startLocation + size, startLocation + size);
+        return makeFail(startLocation, startLocation + 1, message, isRequiredForSuccess);
+    }
+    case Opcode::Literal:
+    {
+        const char32_t *characters = program.characters + operands[0];
+        std::size_t location = startLocation;
+        for(std::size_t i = 0; i < operands[1]; i++)
+        {
+            std::size_t size =
+                location < sourceSize ? matchCharacter(source, sourceSize, location, characters[i]) : 0;
+            if(size == 0)
+            {
+                const char *message = program.getString(operands[2 + i]);
+                if(location >= sourceSize)
+                    return makeFail(location, message, isRequiredForSuccess);
+                return makeFail(location, location + 1, message, isRequiredForSuccess);
+            }
+            location += size;
+        }
+        return makeSuccess(location, location);
+    }
+    case Opcode::CharacterClass:
+    {
+        if(startLocation >= sourceSize)
+            return makeFail(startLocation, unexpectedEndOfInputMessage, isRequiredForSuccess);
+        bool isInverted = operands[0] & CharacterClassFlags::inverted;
+        bool isASCIIClass = (operands[0] & CharacterClassFlags::ascii) && !isInverted;
+        std::size_t nextLocation;
+        char32_t ch = readCharacter(source, sourceSize, startLocation, isASCIIClass, nextLocation);
+        if(characterClassMatches(program, operands, ch) != isInverted)
+            return makeSuccess(nextLocation, nextLocation);
+        return makeFail(
+            startLocation, nextLocation, program.getString(operands[4]), isRequiredForSuccess);
+    }
+    case Opcode::EndOfFile:
+        if(startLocation >= sourceSize)
+            return makeSuccess(startLocation);
+        return makeFail(
+            startLocation, startLocation, expectedEndOfFileMessage, isRequiredForSuccess);
+    }
+    assert(false);
+    return RuleResult();
+}
+
+template <typename CharType>
+typename BasicInterpreter<CharType>::ParseStatus BasicInterpreter<CharType>::parse(
+    std::size_t ruleIndex)
+{
+    RuleResult ruleResult = parseRule(ruleIndex, 0, true);
+    ParseStatus retval;
+    if(ruleResult.success())
+    {
+        retval.location = ruleResult.location;
+    }
+    else
+    {
+        retval.location = errorLocation;
+        retval.message = errorMessage;
+    }
+    return retval;
+}
+
+template <typename CharType>
+typename BasicInterpreter<CharType>::ParseStatus BasicInterpreter<CharType>::parse(
+    const std::string &ruleName)
+{
+    std::size_t ruleIndex = program.findRule(ruleName);
+    if(ruleIndex == ProgramView::noRule)
+        throw std::out_of_range("no rule named " + ruleName);
+    return parse(ruleIndex);
+}
+
+template class BasicInterpreter<char32_t>;
+template class BasicInterpreter<char>;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef INTERPRETER_H_
+#define INTERPRETER_H_
+
+#include "bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bytecode
+{
+// runs a Program over UTF-8 (char) or UTF-32 (char32_t) input, memoizing like a generated
+// parser and reporting the same errors; the source isn't copied. Cuts only prune the
+// alternatives of the choice they're in: memoized results are kept until reset, unlike in a
+// generated parser
+template <typename CharType>
+class BasicInterpreter final
+{
+    BasicInterpreter(const BasicInterpreter &) = delete;
+    BasicInterpreter &operator=(const BasicInterpreter &) = delete;
+
+public:
+    struct RuleResult final
+    {
+        std::size_t location;
+        std::size_t endLocation;
+        bool isSuccess;
+        constexpr RuleResult() noexcept : location(std::string::npos),
+                                          endLocation(0),
+                                          isSuccess(false)
+        {
+        }
+        constexpr RuleResult(std::size_t location, std::size_t endLocation, bool success) noexcept
+            : location(location),
+              endLocation(endLocation),
+              isSuccess(success)
+        {
+        }
+        constexpr bool empty() const
+        {
+            return location == std::string::npos;
+        }
+        constexpr bool success() const
+        {
+            return !empty() && isSuccess;
+        }
+        constexpr bool fail() const
+        {
+            return !empty() && !isSuccess;
+        }
+    };
+    struct ParseStatus
+    {
+        // the end of the match on success, otherwise the error location
+        std::size_t location = 0;
+        // nullptr on success
+        const char *message = nullptr;
+        bool success() const noexcept
+        {
+            return message == nullptr;
+        }
+        explicit operator bool() const noexcept
+        {
+            return success();
+        }
+    };
+
+private:
+    struct MemoEntry final
+    {
+        RuleResult result;
+        bool hasValue = false;
+    };
+    // a chunk holds the memo entries of resultsChunkSize positions; each position gets
+    // program.memoSlotCount entries
+    static constexpr std::size_t resultsChunkSize = 0x100;
+    // index into resultsChunks; 0 is never allocated
+    typedef std::uint32_t ResultsIndex;
+
+private:
+    const ProgramView program;
+    std::vector<std::unique_ptr<MemoEntry[]>> resultsChunks;
+    ResultsIndex resultsUsed = 1;
+    std::vector<ResultsIndex> resultsIndexes;
+    std::unique_ptr<MemoEntry[]> eofResults;
+    const CharType *source;
+    std::size_t sourceSize;
+    std::size_t errorLocation = 0;
+    std::size_t errorInputEndLocation = 0;
+    const char *errorMessage = "no error";
+
+private:
+    MemoEntry *getResults(std::size_t position);
+    RuleResult makeFail(std::size_t location,
+                        std::size_t inputEndLocation,
+                        const char *message,
+                        bool isRequiredForSuccess)
+    {
+        if(isRequiredForSuccess && errorInputEndLocation <= inputEndLocation)
+        {
+            errorLocation = location;
+            errorInputEndLocation = inputEndLocation;
+            errorMessage = message;
+        }
+        return RuleResult(location, inputEndLocation, false);
+    }
+    RuleResult makeFail(std::size_t inputEndLocation,
+                        const char *message,
+                        bool isRequiredForSuccess)
+    {
+        return makeFail(inputEndLocation, inputEndLocation, message, isRequiredForSuccess);
+    }
+    static RuleResult makeSuccess(std::size_t location, std::size_t inputEndLocation)
+    {
+        return RuleResult(location, inputEndLocation, true);
+    }
+    static RuleResult makeSuccess(std::size_t inputEndLocation)
+    {
+        return RuleResult(inputEndLocation, inputEndLocation, true);
+    }
+    RuleResult parseRule(std::size_t ruleIndex,
+                         std::size_t startLocation,
+                         bool isRequiredForSuccess);
+    // choiceIsActive is cleared by a cut in the innermost choice of the rule, if any; it's
+    // nullptr inside predicates, whose cuts don't reach the choice around them
+    RuleResult evaluate(const Word *instruction,
+                        std::size_t startLocation,
+                        bool isRequiredForSuccess,
+                        bool *choiceIsActive);
+
+public:
+    // the program's tables must outlive the interpreter
+    BasicInterpreter(const ProgramView &program, const CharType *source, std::size_t sourceSize);
+    BasicInterpreter(const Program &program, const CharType *source, std::size_t sourceSize)
+        : BasicInterpreter(program.getView(), source, sourceSize)
+    {
+    }
+    void reset(const CharType *source, std::size_t sourceSize);
+    // matches the rule at the start of the source; memoized results are kept until reset
+    ParseStatus parse(std::size_t ruleIndex);
+    // throws std::out_of_range if there isn't a rule with that name
+    ParseStatus parse(const std::string &ruleName);
+};
+
+typedef BasicInterpreter<char32_t> Interpreter;
+typedef BasicInterpreter<char> UTF8Interpreter;
+
+extern template class BasicInterpreter<char32_t>;
+extern template class BasicInterpreter<char>;
+}
+
+#endif /* INTERPRETER_H_ */
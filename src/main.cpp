@@ -23,12 +23,16 @@
 #include "source.h"
 #include "error.h"
 #include "code_generator.h"
+#include "memo_profile.h"
+#include "bytecode.h"
+#include "image.h"
 #include "ast/grammar.h"
 #include "ast/dump_visitor.h"
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <string>
+#include <cctype>
 
 std::string removeExtension(std::string fileName)
 {
@@ -58,6 +62,9 @@ int main(int argc, char **argv)
     std::string inputFile = "";
     std::string outputSourceFile = "";
     std::string outputHeaderFile = "";
+    CodeGenerator::CPlusPlus11Settings codeGeneratorSettings;
+    std::string memoProfileFile = "";
+    bool writeGrammarImage = false;
     bool canParseOptions = true;
     for(int i = 1; i < argc; i++)
     {
@@ -76,9 +83,153 @@ Options:
 -h
 --help             Show this help.
 -o<output>         Set the output file name.
+--utf8             Generate a parser that works directly on UTF-8 input.
+--memo-table=<kind>
+                   Set how memoized results are looked up by position:
+                   dense (default): a table with an entry per input position.
+                   hash: a hash table sized by the positions actually visited.
+                   window: only keep results near the furthest position reached.
+--memo-window=<size>
+                   Set the number of positions kept behind the furthest
+                   position reached for --memo-table=window. Default: 4096.
+--compact-memo     Store memoized results as 32-bit offsets from their
+                   position, falling back to full-size results for offsets
+                   that don't fit.
+--memo-profile     Generate a parser that counts how often each rule's
+                   memoized results are reused; write the counts with
+                   Parser::writeMemoProfile.
+--memo-profile-use=<file>
+                   Turn off memoization for rules that were never reused
+                   according to a profile written by Parser::writeMemoProfile.
+--profile          Generate a parser that counts invocations, memo hits and
+                   misses, successes, failures and characters consumed for
+                   each rule; read the counts with Parser::profile or write
+                   them with Parser::writeProfileJSON or
+                   Parser::writeProfileCSV. Rules aren't inlined.
+--profile-cycles   Like --profile, also counting the cycles spent in each
+                   rule, including the rules it calls.
+--defer-actions    Generate a parser that only records which alternatives
+                   matched while parsing, then runs the code snippets along
+                   the accepted parse. Rules with custom predicates, or with
+                   code or variables inside predicates, and the rules they
+                   call run their code while parsing. Code called only from
+                   inside predicates isn't run.
+--value-arena      Generate a parser with a Parser::ValueArena that's
+                   released by reset, and Parser::ValueAllocator,
+                   Parser::ValueString and Parser::ValueVector that allocate
+                   from it while parsing, so values built by the code
+                   snippets don't need separate heap allocations. Returned
+                   values can use the arena, so they must be copied to
+                   outlive reset or the parser; copies made after parsing
+                   allocate from the heap.
+--inline-limit=<size>
+                   Expand rules that aren't memoized or recursive at their
+                   call sites when their expression has at most <size> nodes.
+                   Rules marked @inline are always expanded. Default: 8.
+--image            Write a precompiled grammar image for
+                   bytecode::MappedImage instead of a parser. The output file
+                   name defaults to the input file name with a .pegimage
+                   extension.
 )";
                 return 0;
             }
+            if(arg == "--utf8")
+            {
+                codeGeneratorSettings.utf8Input = true;
+                continue;
+            }
+            if(arg == "--image")
+            {
+                writeGrammarImage = true;
+                continue;
+            }
+            if(arg == "--compact-memo")
+            {
+                codeGeneratorSettings.compactMemo = true;
+                continue;
+            }
+            if(arg == "--profile")
+            {
+                codeGeneratorSettings.ruleProfile = true;
+                continue;
+            }
+            if(arg == "--profile-cycles")
+            {
+                codeGeneratorSettings.ruleProfile = true;
+                codeGeneratorSettings.ruleProfileCycles = true;
+                continue;
+            }
+            if(arg == "--defer-actions")
+            {
+                codeGeneratorSettings.deferActions = true;
+                continue;
+            }
+            if(arg == "--value-arena")
+            {
+                codeGeneratorSettings.valueArena = true;
+                continue;
+            }
+            if(arg == "--memo-profile")
+            {
+                codeGeneratorSettings.memoProfile = true;
+                continue;
+            }
+            if(arg.compare(0, 19, "--memo-profile-use=") == 0)
+            {
+                arg.erase(0, 19);
+                if(arg.empty())
+                {
+                    std::cerr << "empty --memo-profile-use file name" << std::endl;
+                    return 1;
+                }
+                memoProfileFile = std::move(arg);
+                continue;
+            }
+            if(arg.compare(0, 15, "--inline-limit=") == 0)
+            {
+                arg.erase(0, 15);
+                std::istringstream ss(arg);
+                std::size_t inlineSizeLimit;
+                if(arg.empty() || !std::isdigit(arg[0]) || !(ss >> inlineSizeLimit) || !ss.eof())
+                {
+                    std::cerr << "invalid --inline-limit argument" << std::endl;
+                    return 1;
+                }
+                codeGeneratorSettings.inlineSizeLimit = inlineSizeLimit;
+                continue;
+            }
+            if(arg.compare(0, 13, "--memo-table=") == 0)
+            {
+                arg.erase(0, 13);
+                if(arg == "dense")
+                    codeGeneratorSettings.memoTable =
+                        CodeGenerator::CPlusPlus11Settings::MemoTable::Dense;
+                else if(arg == "hash")
+                    codeGeneratorSettings.memoTable =
+                        CodeGenerator::CPlusPlus11Settings::MemoTable::Hashed;
+                else if(arg == "window")
+                    codeGeneratorSettings.memoTable =
+                        CodeGenerator::CPlusPlus11Settings::MemoTable::Windowed;
+                else
+                {
+                    std::cerr << "invalid --memo-table argument" << std::endl;
+                    return 1;
+                }
+                continue;
+            }
+            if(arg.compare(0, 14, "--memo-window=") == 0)
+            {
+                arg.erase(0, 14);
+                std::istringstream ss(arg);
+                std::size_t memoWindowSize;
+                if(arg.empty() || !std::isdigit(arg[0]) || !(ss >> memoWindowSize) || !ss.eof())
+                {
+                    std::cerr << "invalid --memo-window argument" << std::endl;
+                    return 1;
+                }
+                codeGeneratorSettings.memoWindowSize = memoWindowSize;
+                continue;
+            }
             if(arg.compare(0, 2, "-o") == 0)
             {
                 if(arg.size() > 2)
@@ -138,6 +289,7 @@ Options:
             errorHandler(ErrorLevel::FatalError, Location(), "no input files");
             return 1;
         }
+        const char *outputExtension = writeGrammarImage ? ".pegimage" : ".cpp";
         if(outputSourceFile.empty())
         {
             if(inputFile == "-")
@@ -147,11 +299,11 @@ Options:
                              "missing output file name when input file is stdin");
                 return 1;
             }
-            outputSourceFile = removeExtension(inputFile) + ".cpp";
+            outputSourceFile = removeExtension(inputFile) + outputExtension;
         }
         else if(outputSourceFile == removeExtension(outputSourceFile))
         {
-            outputSourceFile += ".cpp";
+            outputSourceFile += outputExtension;
         }
         if(outputHeaderFile.empty())
         {
@@ -159,14 +311,54 @@ Options:
         }
         const Source *source = Source::load(arena, errorHandler, inputFile);
         ast::Grammar *grammar = parseGrammar(arena, errorHandler, source);
-        if(!errorHandler.hasAnyErrors())
+        if(!errorHandler.hasAnyErrors() && !memoProfileFile.empty())
+        {
+            applyMemoProfile(
+                errorHandler, grammar, Source::load(arena, errorHandler, memoProfileFile));
+        }
+        if(!errorHandler.hasAnyErrors() && writeGrammarImage)
+        {
+            bytecode::Program program;
+            CodeGenerator::makeBytecode(errorHandler, program)->generateCode(grammar);
+            std::ostringstream imageStream;
+            try
+            {
+                bytecode::writeImage(imageStream, program);
+            }
+            catch(bytecode::ImageError &e)
+            {
+                errorHandler(ErrorLevel::FatalError, Location(), e.what());
+            }
+            std::ofstream os;
+            os.open(outputSourceFile, std::ios::binary);
+            if(!os)
+            {
+                errorHandler(ErrorLevel::FatalError,
+                             Location(),
+                             "can't open output file: '",
+                             outputSourceFile,
+                             "'");
+                return 1;
+            }
+            os << imageStream.str();
+            if(!os)
+            {
+                errorHandler(ErrorLevel::FatalError,
+                             Location(),
+                             "io error");
+                return 1;
+            }
+            os.close();
+        }
+        else if(!errorHandler.hasAnyErrors())
         {
             std::ostringstream headerStream, sourceStream;
             CodeGenerator::makeCPlusPlus11(sourceStream,
                                            headerStream,
                                            outputHeaderFile,
                                            removePath(outputHeaderFile),
-                                           outputSourceFile)->generateCode(grammar);
+                                           outputSourceFile,
+                                           codeGeneratorSettings)->generateCode(grammar);
             std::ofstream os;
             os.open(outputHeaderFile);
             if(!os)
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#include "memo_profile.h"
+#include "source.h"
+#include "error.h"
+#include "location.h"
+#include "ast/grammar.h"
+#include "ast/nonterminal.h"
+#include <unordered_map>
+#include <cctype>
+#include <string>
+
+namespace
+{
+bool isSpace(char ch)
+{
+    return ch == ' ' || ch == '\t';
+}
+
+bool isNewLine(char ch)
+{
+    return ch == '\r' || ch == '\n';
+}
+}
+
+void applyMemoProfile(ErrorHandler &errorHandler, ast::Grammar *grammar, const Source *profile)
+{
+    std::unordered_map<std::string, ast::Nonterminal *> nonterminals;
+    for(ast::Nonterminal *nonterminal : grammar->nonterminals)
+        nonterminals[nonterminal->name] = nonterminal;
+    const std::string &contents = profile->contents;
+    std::size_t position = 0;
+    while(position < contents.size())
+    {
+        while(position < contents.size()
+              && (isSpace(contents[position]) || isNewLine(contents[position])))
+            position++;
+        if(position >= contents.size())
+            break;
+        Location lineLocation(profile, position);
+        std::string fields[3];
+        std::size_t fieldCount = 0;
+        while(position < contents.size() && !isNewLine(contents[position]))
+        {
+            if(isSpace(contents[position]))
+            {
+                position++;
+                continue;
+            }
+            std::string field;
+            while(position < contents.size() && !isSpace(contents[position])
+                  && !isNewLine(contents[position]))
+                field += contents[position++];
+            if(fieldCount < 3)
+                fields[fieldCount] = std::move(field);
+            fieldCount++;
+        }
+        std::size_t counts[2];
+        bool valid = fieldCount == 3;
+        for(std::size_t i = 0; i < 2 && valid; i++)
+        {
+            const std::string &field = fields[i + 1];
+            counts[i] = 0;
+            for(char ch : field)
+            {
+                if(!std::isdigit(static_cast<unsigned char>(ch)))
+                    valid = false;
+                else
+                    counts[i] = counts[i] * 10 + (ch - '0');
+            }
+        }
+        if(!valid)
+        {
+            errorHandler(ErrorLevel::Error, lineLocation, "expected: <rule> <hits> <misses>");
+            continue;
+        }
+        auto iter = nonterminals.find(fields[0]);
+        if(iter == nonterminals.end())
+        {
+            errorHandler(ErrorLevel::Warning, lineLocation, "rule not in grammar: ", fields[0]);
+            continue;
+        }
+        ast::Nonterminal *nonterminal = std::get<1>(*iter);
+        if(counts[0] == 0 && !nonterminal->settings.memoizeValue
+           && !nonterminal->settings.cachingOverridden)
+            nonterminal->settings.caching = false;
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2012-2016 Jacob R. Lifshay
+ * This file is part of Voxels.
+ *
+ * Voxels is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Voxels is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Voxels; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef MEMO_PROFILE_H_
+#define MEMO_PROFILE_H_
+
+namespace ast
+{
+struct Grammar;
+}
+
+struct ErrorHandler;
+struct Source;
+
+// reads a profile written by a parser generated with --memo-profile and turns off caching
+// for rules whose memoized results were never reused, unless set by an annotation
+void applyMemoProfile(ErrorHandler &errorHandler, ast::Grammar *grammar, const Source *profile);
+
+#endif /* MEMO_PROFILE_H_ */
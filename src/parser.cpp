@@ -25,6 +25,7 @@
 #include "ast/grammar.h"
 #include "ast/nonterminal.h"
 #include "ast/empty.h"
+#include "ast/cut.h"
 #include "ast/expression.h"
 #include "ast/ordered_choice.h"
 #include "ast/predicate.h"
@@ -78,6 +79,8 @@ struct Parser final
             RAngle,
             Amp,
             Comma,
+            Tilde,
+            Annotation,
             String,
             Identifier,
             EOFKeyword,
@@ -509,6 +512,51 @@ struct Parser final
                                                        value.size());
                             get();
                         }
+                        else if(peek == 'm')
+                        {
+                            std::string word;
+                            while(isIdentifierContinue(peek))
+                            {
+                                word += static_cast<char>(get());
+                            }
+                            if(word != "move" || peek != '(')
+                            {
+                                errorHandler(ErrorLevel::Warning,
+                                             tokenLocation,
+                                             "unrecognized code substitution");
+                                value += '$';
+                                value += word;
+                                continue;
+                            }
+                            get();
+                            while(peek == ' ' || peek == '\t')
+                                get();
+                            if(!isIdentifierStart(peek))
+                            {
+                                errorHandler(ErrorLevel::FatalError,
+                                             currentLocation,
+                                             "$move missing variable name");
+                                return Token();
+                            }
+                            std::string name;
+                            while(isIdentifierContinue(peek))
+                            {
+                                name += static_cast<char>(get());
+                            }
+                            while(peek == ' ' || peek == '\t')
+                                get();
+                            if(peek != ')')
+                            {
+                                errorHandler(ErrorLevel::FatalError,
+                                             currentLocation,
+                                             "$move missing closing )");
+                                return Token();
+                            }
+                            get();
+                            substitutions.emplace_back(
+                                ast::ExpressionCodeSnippet::Substitution::Kind::Move, value.size());
+                            value += "(" + name + ")";
+                        }
                         else
                         {
                             errorHandler(ErrorLevel::Warning,
@@ -677,6 +725,26 @@ struct Parser final
                 get();
                 return Token(std::move(tokenLocation), Token::Type::Comma, "");
             }
+            case '~':
+            {
+                get();
+                return Token(std::move(tokenLocation), Token::Type::Tilde, "");
+            }
+            case '@':
+            {
+                get();
+                if(!isIdentifierStart(peek))
+                {
+                    errorHandler(ErrorLevel::FatalError, currentLocation, "missing annotation name");
+                    return Token(std::move(tokenLocation), Token::Type::EndOfFile, "");
+                }
+                std::string value;
+                while(isIdentifierContinue(peek))
+                {
+                    value += static_cast<char>(get());
+                }
+                return Token(std::move(tokenLocation), Token::Type::Annotation, std::move(value));
+            }
             default:
                 errorHandler(ErrorLevel::FatalError, tokenLocation, "invalid character");
                 return Token(std::move(tokenLocation), Token::Type::EndOfFile, "");
@@ -1142,27 +1210,34 @@ struct Parser final
             next();
             return retval;
         }
+        case Token::Type::Tilde:
+        {
+            auto retval = arena.make<ast::Cut>(token.location);
+            currentNonterminal->settings.hasCut = true;
+            next();
+            return retval;
+        }
         case Token::Type::String:
         {
             ast::Expression *retval = nullptr;
+            std::u32string value;
             std::size_t position = 0;
             while(position < token.value.size())
             {
-                auto ch = parseCharacterValue(position, CharacterLocation::String);
-                auto terminal = arena.make<ast::Terminal>(token.location, ch);
-                if(retval)
-                {
-                    retval = arena.make<ast::Sequence>(token.location, retval, terminal);
-                }
-                else
-                {
-                    retval = terminal;
-                }
+                value += parseCharacterValue(position, CharacterLocation::String);
             }
-            if(retval == nullptr)
+            if(value.empty())
             {
                 retval = arena.make<ast::Empty>(token.location);
             }
+            else if(value.size() == 1)
+            {
+                retval = arena.make<ast::Terminal>(token.location, value[0]);
+            }
+            else
+            {
+                retval = arena.make<ast::Literal>(token.location, std::move(value));
+            }
             next();
             return retval;
         }
@@ -1286,6 +1361,7 @@ struct Parser final
             case Token::Type::NamespaceKeyword:
             case Token::Type::Comma:
             case Token::Type::RAngle:
+            case Token::Type::Annotation:
                 done = true;
                 break;
             case Token::Type::QMark:
@@ -1297,6 +1373,7 @@ struct Parser final
             case Token::Type::String:
             case Token::Type::Identifier:
             case Token::Type::EOFKeyword:
+            case Token::Type::Tilde:
             case Token::Type::CharacterClass:
             case Token::Type::CodeSnippet:
             case Token::Type::TrueKeyword:
@@ -1327,6 +1404,12 @@ struct Parser final
     }
     ast::Nonterminal *parseRule()
     {
+        std::vector<Token> annotations;
+        while(token.type == Token::Type::Annotation)
+        {
+            annotations.push_back(token);
+            next();
+        }
         if(token.type != Token::Type::Identifier)
         {
             errorHandler(ErrorLevel::FatalError, token.location, "missing rule name");
@@ -1340,6 +1423,43 @@ struct Parser final
             errorHandler(ErrorLevel::Info, retval->location, "previous rule definition");
             retval->expression = nullptr;
         }
+        Location memoizeValueLocation;
+        Location cachingLocation;
+        for(const Token &annotation : annotations)
+        {
+            if(annotation.value == "memovalue")
+            {
+                retval->settings.memoizeValue = true;
+                memoizeValueLocation = annotation.location;
+            }
+            else if(annotation.value == "memo" || annotation.value == "nomemo"
+                    || annotation.value == "inline")
+            {
+                bool caching = annotation.value == "memo";
+                if(retval->settings.cachingOverridden && retval->settings.caching != caching)
+                {
+                    errorHandler(ErrorLevel::Error, annotation.location, "conflicting annotation");
+                    errorHandler(ErrorLevel::Info, cachingLocation, "previous annotation");
+                    continue;
+                }
+                retval->settings.caching = caching;
+                retval->settings.cachingOverridden = true;
+                cachingLocation = annotation.location;
+                if(annotation.value == "inline")
+                    retval->settings.forceInline = true;
+            }
+            else
+            {
+                errorHandler(ErrorLevel::Error, annotation.location, "unknown annotation");
+            }
+        }
+        if(retval->settings.memoizeValue && retval->settings.cachingOverridden
+           && !retval->settings.caching)
+        {
+            errorHandler(ErrorLevel::Error, memoizeValueLocation, "conflicting annotation");
+            errorHandler(ErrorLevel::Info, cachingLocation, "previous annotation");
+            retval->settings.memoizeValue = false;
+        }
         next();
         if(token.type == Token::Type::LAngle)
         {
@@ -1431,6 +1551,11 @@ struct Parser final
         {
             retval->type = voidType;
         }
+        if(retval->settings.memoizeValue && retval->type->isVoid)
+        {
+            errorHandler(ErrorLevel::Warning, memoizeValueLocation, "rule has no value to memoize");
+            retval->settings.memoizeValue = false;
+        }
         return retval;
     }
     void parseType()
@@ -1597,7 +1722,8 @@ struct Parser final
             return nullptr;
         for(auto nonterminal : nonterminals)
         {
-            if(nonterminal->settings.caching && nonterminal->expression)
+            if(nonterminal->settings.caching && nonterminal->expression
+               && !nonterminal->settings.memoizeValue && !nonterminal->settings.cachingOverridden)
             {
                 nonterminal->settings.caching = nonterminal->expression->defaultNeedsCaching();
             }
@@ -1696,6 +1822,20 @@ struct Parser final
                 }
             }
         }
+        for(auto nonterminal : nonterminals)
+        {
+            nonterminal->settings.firstSet = ast::FirstSet();
+        }
+        for(bool done = false; !done;)
+        {
+            done = true;
+            for(auto nonterminal : nonterminals)
+            {
+                if(nonterminal->expression
+                   && nonterminal->settings.firstSet.insert(nonterminal->expression->getFirstSet()))
+                    done = false;
+            }
+        }
         for(bool done = false; !done;)
         {
             done = true;